@@ -0,0 +1,74 @@
+#include <pebble.h>
+#include "accounts.h"
+#include "log.h"
+
+static accounts_t table;
+static uint8_t num_accounts;
+
+void accounts_reset()
+{
+  memset(&table, 0, sizeof(accounts_t));
+  num_accounts = 0;
+}
+
+void accounts_load(uint32_t persist_key)
+{
+  accounts_reset();
+  if( !persist_exists(persist_key) || persist_get_size(persist_key) != sizeof(accounts_t) )
+    return;
+
+  persist_read_data(persist_key, &table, sizeof(accounts_t));
+  while( num_accounts < MAX_ACCOUNTS && table.accounts[num_accounts].counts[ACCOUNT_RECEIVED] > 0 )
+    num_accounts++;
+}
+
+void accounts_save(uint32_t persist_key)
+{
+  persist_write_data(persist_key, &table, sizeof(accounts_t));
+}
+
+// Entry for account_id. With add, a new account takes a free entry or the
+// quietest account's when the table is full.
+static account_stats_t* find_account(uint32_t account_id, bool add)
+{
+  account_stats_t *quietest = NULL;
+  for( uint8_t i = 0; i < num_accounts; i++ )
+  {
+    account_stats_t *entry = &table.accounts[i];
+    if( entry->account_id == account_id )
+      return entry;
+    if( quietest == NULL || entry->counts[ACCOUNT_RECEIVED] < quietest->counts[ACCOUNT_RECEIVED] )
+      quietest = entry;
+  }
+
+  if( !add )
+    return NULL;
+
+  account_stats_t *entry = num_accounts < MAX_ACCOUNTS ? &table.accounts[num_accounts++] : quietest;
+  memset(entry, 0, sizeof(account_stats_t));
+  entry->account_id = account_id;
+  return entry;
+}
+
+void accounts_count(uint32_t account_id, AccountStat stat)
+{
+  // Only received mail earns an account a place in the table
+  account_stats_t *entry = find_account(account_id, stat == ACCOUNT_RECEIVED);
+  if( entry && entry->counts[stat] < UINT16_MAX )
+    entry->counts[stat]++;
+}
+
+void accounts_write(DictionaryIterator *iter, uint32_t key)
+{
+  dict_write_data(iter, key, (const uint8_t*)&table, sizeof(accounts_t));
+}
+
+void accounts_log()
+{
+  for( uint8_t i = 0; i < num_accounts; i++ )
+  {
+    account_stats_t *entry = &table.accounts[i];
+    LOG_INFO(LOG_CAT_STORE, "Account %u: received=%u evicted=%u deleted=%u", (unsigned)entry->account_id,
+             entry->counts[ACCOUNT_RECEIVED], entry->counts[ACCOUNT_EVICTED], entry->counts[ACCOUNT_DELETED]);
+  }
+}
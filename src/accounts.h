@@ -0,0 +1,35 @@
+#pragma once
+#include <pebble.h>
+
+// Per-account counters for the accounts seen most, kept across launches and
+// sent to the phone beside the metrics dump. The wire format of
+// accounts_write is the packed table below as a single byte array tuple.
+
+#define MAX_ACCOUNTS 4
+
+typedef enum AccountStat {
+  ACCOUNT_RECEIVED,
+  ACCOUNT_EVICTED,
+  ACCOUNT_DELETED,
+  NUM_ACCOUNT_STATS
+} AccountStat;
+
+typedef struct account_stats_t
+{
+  uint32_t account_id;
+  uint16_t counts[NUM_ACCOUNT_STATS];
+} __attribute__((__packed__)) account_stats_t;
+
+typedef struct accounts_t
+{
+  account_stats_t accounts[MAX_ACCOUNTS];
+} __attribute__((__packed__)) accounts_t;
+
+void accounts_load(uint32_t persist_key);
+void accounts_save(uint32_t persist_key);
+void accounts_reset();
+
+void accounts_count(uint32_t account_id, AccountStat stat);
+
+void accounts_write(DictionaryIterator *iter, uint32_t key);
+void accounts_log();
@@ -1,41 +1,71 @@
 #include <pebble.h>
+#include "animated_ab.h"
 
+#define ANIMATION_DURATION_MS 400
+
+// One animation is created up front and retargeted for every move, so showing
+// and hiding the action bar never allocates
 static PropertyAnimation *prop_animation;
+static Layer *action_bar_layer;
+static int16_t shown_x;
+static int16_t hidden_x;
+static bool animations_enabled = true;
+
+void animated_ab_init(ActionBarLayer *action_bar, GRect window_bounds) {
+	action_bar_layer = action_bar_layer_get_layer(action_bar);
+	shown_x = window_bounds.size.w - ACTION_BAR_WIDTH;
+	hidden_x = window_bounds.size.w;
+
+	GRect frame = layer_get_frame(action_bar_layer);
+	prop_animation = property_animation_create_layer_frame(action_bar_layer, &frame, &frame);
+}
 
-static void destroy_property_animation(PropertyAnimation **prop_animation) {
-	if (*prop_animation == NULL) {
+void animated_ab_deinit(void) {
+	if (prop_animation == NULL) {
 		return;
 	}
 
-	if (animation_is_scheduled((Animation*) *prop_animation)) {
-		animation_unschedule((Animation*) *prop_animation);
+	if (animation_is_scheduled((Animation*) prop_animation)) {
+		animation_unschedule((Animation*) prop_animation);
 	}
 
-	property_animation_destroy(*prop_animation);
-	*prop_animation = NULL;
+	property_animation_destroy(prop_animation);
+	prop_animation = NULL;
 }
 
-static void animation_stopped(Animation *animation, bool finished, void *data) {
-	destroy_property_animation(&prop_animation);
+void animated_ab_set_enabled(bool enabled) {
+	animations_enabled = enabled;
 }
 
-static void move_actionbar(ActionBarLayer *action_bar, bool in){
-	Layer *layer = action_bar_layer_get_layer(action_bar);
+static void move_actionbar(bool in){
+	int16_t target_x = in ? shown_x : hidden_x;
 
-	GRect to_rect = layer_get_bounds(layer);
-	to_rect.origin.y = 3;
+	// Start from wherever the bar is now, so reversing a move half way through
+	// turns around instead of jumping back to the start
+	if (animation_is_scheduled((Animation*) prop_animation)) {
+		animation_unschedule((Animation*) prop_animation);
+	}
 
-	if(in){
-		to_rect.origin.x = 144 - 20;
+	GRect from_rect = layer_get_frame(action_bar_layer);
+	GRect to_rect = from_rect;
+	to_rect.origin.x = target_x;
+
+	int16_t distance = target_x - from_rect.origin.x;
+	if (distance < 0) {
+		distance = -distance;
 	}
-	else {
-		to_rect.origin.x = 144;
+	if (distance == 0) {
+		return;
 	}
 
-	destroy_property_animation(&prop_animation);
+	if (!animations_enabled) {
+		layer_set_frame(action_bar_layer, to_rect);
+		return;
+	}
 
-	prop_animation = property_animation_create_layer_frame(layer, NULL, &to_rect);
-	animation_set_duration((Animation*) prop_animation, 400);
+	prop_animation->values.from.grect = from_rect;
+	prop_animation->values.to.grect = to_rect;
+	animation_set_duration((Animation*) prop_animation, ANIMATION_DURATION_MS * distance / (hidden_x - shown_x));
 	if(in){
 		animation_set_curve((Animation*) prop_animation, AnimationCurveEaseIn);
 	}
@@ -43,16 +73,13 @@ static void move_actionbar(ActionBarLayer *action_bar, bool in){
 		animation_set_curve((Animation*) prop_animation, AnimationCurveEaseOut);
 	}
 
-	animation_set_handlers((Animation*) prop_animation, (AnimationHandlers) {
-		.stopped = (AnimationStoppedHandler) animation_stopped,
-  		}, NULL /* callback data */);
 	animation_schedule((Animation*) prop_animation);
 }
 
 void show_actionbar(ActionBarLayer *action_bar){
-	move_actionbar(action_bar, true);
+	move_actionbar(true);
 }
 
 void hide_actionbar(ActionBarLayer *action_bar){
-	move_actionbar(action_bar, false);
-}
\ No newline at end of file
+	move_actionbar(false);
+}
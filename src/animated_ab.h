@@ -1,5 +1,10 @@
 #pragma once
 #include <pebble.h>
 
+void animated_ab_init(ActionBarLayer *action_bar, GRect window_bounds);
+void animated_ab_deinit(void);
+// With animations disabled the bar moves straight to its new position
+void animated_ab_set_enabled(bool enabled);
+
 void show_actionbar(ActionBarLayer *action_bar);
-void hide_actionbar(ActionBarLayer *action_bar);
\ No newline at end of file
+void hide_actionbar(ActionBarLayer *action_bar);
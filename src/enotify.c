@@ -1,11 +1,33 @@
 // Standard includes
 #include "pebble.h"
 #include "animated_ab.h"
+#include "text_codec.h"
+#include "metrics.h"
+#include "log.h"
+#include "power.h"
+#include "vibe.h"
+#include "accounts.h"
   
 #define MAX_MESSAGES 5
 #define MAX_TEXT_LENGTH 124
 #define MAX_UUID_LENGTH 50
 
+// Most a single inbound message should cost: one slot persisted and one full
+// refresh and relayout of the UI
+#define INBOUND_BUDGET_MS 100
+#define INBOUND_BUDGET_PERSIST_BYTES (2*PERSIST_DATA_MAX_LENGTH)
+#define INBOUND_BUDGET_LAYER_UPDATES (2*MAX_MESSAGES+1)
+
+// How long the app stays open after the last activity. Someone who has
+// pressed a button gets the full timeout, a launch that only shows incoming
+// mail a shorter one. While a command, service message or body stream is
+// still pending the app is kept alive a few extra periods so the next
+// notification doesn't pay for a cold start.
+#define KILL_TIMEOUT_MS (30*1000)
+#define KILL_TIMEOUT_IDLE_MS (15*1000)
+#define KILL_TIMEOUT_PENDING_MS (10*1000)
+#define KILL_MAX_EXTENSIONS 3
+
 // App-specific data
 Window *window; // All apps must have at least one window
 
@@ -15,13 +37,7 @@ static AppTimer* error_hide_timer;
 // All the UI layers
 static ActionBarLayer *action_bar;
 static ScrollLayer *scroll_layer;
-static TextLayer *master_text_layer;
-static TextLayer *text_layer[MAX_MESSAGES];
-static BitmapLayer *header_bubble_layer[MAX_MESSAGES];
-static TextLayer *header_text_layer[MAX_MESSAGES];
-static TextLayer *from_text_layer[MAX_MESSAGES];
-static TextLayer *subject_text_layer[MAX_MESSAGES];
-static TextLayer *footer_text_layer[MAX_MESSAGES];
+static Layer *card_layer[MAX_MESSAGES];
 static TextLayer *deleteConfirmLayer;
 static BitmapLayer *trashImageLayer;
 static BitmapLayer *questionImageLayer;
@@ -29,6 +45,7 @@ static TextLayer *pressAgainTextLayer;
 static TextLayer *errorLayer;
 static BitmapLayer *errorImageLayer;
 static TextLayer *errorConfirmationTextLayer;
+static Layer *list_layer;
 
 // All the bitmaps we use
 static GBitmap* upArrow;
@@ -43,8 +60,17 @@ static GBitmap* bubble;
 static GBitmap* deleted_bubble;
 static GBitmap* error_icon;
 
+// Rows of the summary list, each the sender over the subject
+#define LIST_ROW_HEIGHT 36
+
 // The mode defines what the action bar commands will be and is one of ModeType
 static uint8_t mode;
+static uint8_t icon_mode;
+
+// Index of the message in view, 0 being the newest, and the height of a page
+static int8_t cursor;
+static int16_t page_height;
+static int16_t scroll_y;
 
 static uint8_t actions_enabled;
 static uint8_t retries;
@@ -52,11 +78,30 @@ static int msg_cmd;
 static uint32_t msg_account;
 static char msg_uuid[MAX_TEXT_LENGTH];
 static int msg_send_index;
+static uint8_t service_in_flight;
+static uint8_t body_pending;
+static uint8_t user_active;
+static uint8_t kill_extensions;
+
+// Latency measurement: when the newest message arrived until its card was
+// first drawn, and when a command was sent until the phone acknowledged it
+static int8_t render_pending_slot;
+static uint32_t render_start;
+static uint32_t command_start;
+static uint32_t inbound_start;
+
+#ifdef DEBUG_COMMANDS
+// Outbound failures queued by the inject debug commands, oldest first, used
+// in place of the next sends so the retry and error paths can be driven from
+// the phone
+#define MAX_INJECTED_FAILURES 8
+static AppMessageResult injected_failure[MAX_INJECTED_FAILURES];
+static uint8_t injected_failures;
+#endif
 
 // Lorum ipsum to have something to scroll
 static int32_t header_time[MAX_MESSAGES];
 static uint32_t account_id[MAX_MESSAGES];
-static uint8_t deleted[MAX_MESSAGES];
 static char header_text[MAX_MESSAGES][MAX_TEXT_LENGTH];
 static char scroll_text[MAX_MESSAGES][MAX_TEXT_LENGTH];
 static char from_text[MAX_MESSAGES][MAX_TEXT_LENGTH];
@@ -64,35 +109,129 @@ static char subject_text[MAX_MESSAGES][MAX_TEXT_LENGTH];
 static char uuid_text[MAX_MESSAGES][MAX_TEXT_LENGTH];
 static char footer_text[MAX_MESSAGES][MAX_TEXT_LENGTH];
 
+// Bit per ring slot that has been read from storage, see do_init
+#define ALL_SLOTS_LOADED ((1 << MAX_MESSAGES)-1)
+#define DEFERRED_LOAD_MS 100
+static uint32_t slots_loaded;
+
+// Slot state, a bit per slot so eviction can pick a kind of slot with a mask.
+// Account reserves are not kept as bits; reserved_slots counts them from the
+// store on each eviction. Read state is saved lazily, see do_deinit.
+#define SLOT_BIT(slot) (1 << (slot))
+static uint8_t filled_slots;
+static uint8_t deleted_slots;
+static uint8_t read_slots;
+static uint8_t priority_slots;
+static uint8_t unsaved_slots;
+
+// Measured height of each slot's body text, 0 until measured. Card layout and
+// the card's update proc both use it, so the text is measured once per body.
+static int16_t body_height[MAX_MESSAGES];
+static GFont body_font;
+static GFont bold_font;
+static GSize body_box;
+
+// Each message is a card as tall as its content, stacked in the scroll layer
+// newest first. card_offset[] holds the running total of card heights, so
+// card i spans card_offset[i] to card_offset[i+1].
+#define CARD_FROM_TOP 16
+#define CARD_SUBJECT_TOP 32
+#define CARD_BODY_TOP 62
+#define CARD_FOOTER_HEIGHT 22
+#define CARD_PAGE_OVERLAP 16
+static int16_t card_offset[MAX_MESSAGES+1];
+static int16_t content_height;
+
+// The messages shown, newest first: all of them, or only one account's while
+// the list is filtered
+#define DEFAULT_ACCOUNT_RESERVE 1
+static int8_t view[MAX_MESSAGES];
+static int8_t view_count;
+static bool account_filtered;
+static uint32_t account_filter;
+
 typedef struct app_data_t
 {
   int num_messages_filled;
   int next_write_index;
   int utc_offset;
   int actions_enabled;
+  int low_power_threshold;
+  // Slots newest first; the first num_messages_filled hold messages and the
+  // rest are free. Replaces next_write_index, which is only read to build
+  // the order for metadata saved before it existed.
+  int8_t order[MAX_MESSAGES];
+  // Messages each account keeps when another account's mail needs the space
+  int account_reserve;
+  int eviction_policy;
+  // Bumped on every slot write; each slot keeps the value it was last
+  // written at, so the phone can tell what changed since it last synced
+  uint32_t generation;
+  uint32_t slot_generation[MAX_MESSAGES];
 } app_data_t;
 static app_data_t app_metadata;
 
+// Persisted layout of a message slot. Text fields are stored back to back in
+// data[], each either text_codec encoded or raw as flagged, and only the used
+// part of the record is written.
+#define PERSIST_KEY_METADATA 0x0
+#define PERSIST_KEY_VERSION 0x1
+#define PERSIST_KEY_METRICS 0x2
+#define PERSIST_KEY_ACCOUNTS 0x3
+#define PERSIST_VERSION 2
+#define PERSIST_KEY_MESSAGE(index) (0x10*((index)+1))
+
+enum PersistFlags {
+  PERSIST_UUID_ENCODED = 0x1,
+  PERSIST_TEXT_ENCODED = 0x2,
+  PERSIST_FROM_ENCODED = 0x4,
+  PERSIST_SUBJECT_ENCODED = 0x8,
+  PERSIST_READ = 0x10,
+  PERSIST_PRIORITY = 0x20,
+};
+
 typedef struct message_1_t
 {
   int header_time;
   int account_id;
   uint8_t deleted;
-  char uuid_text[MAX_TEXT_LENGTH-10];
-  char scroll_text[MAX_TEXT_LENGTH];
+  uint8_t flags;
+  uint8_t uuid_length;
+  uint8_t text_length;
+  uint8_t data[PERSIST_DATA_MAX_LENGTH-12];
 }  __attribute__((__packed__)) message_1_t;
 
 typedef struct message_2_t
+{
+  uint8_t flags;
+  uint8_t from_length;
+  uint8_t subject_length;
+  uint8_t data[PERSIST_DATA_MAX_LENGTH-3];
+}  __attribute__((__packed__)) message_2_t;
+
+// Version 1 records, read once to migrate stores written by older builds
+typedef struct legacy_message_1_t
+{
+  int header_time;
+  int account_id;
+  uint8_t deleted;
+  char uuid_text[MAX_TEXT_LENGTH-10];
+  char scroll_text[MAX_TEXT_LENGTH];
+}  __attribute__((__packed__)) legacy_message_1_t;
+
+typedef struct legacy_message_2_t
 {
   char from_text[MAX_TEXT_LENGTH];
   char subject_text[MAX_TEXT_LENGTH];
-}  __attribute__((__packed__)) message_2_t;
+}  __attribute__((__packed__)) legacy_message_2_t;
 
 enum ModeType {
   MODE_SCROLL = 0x0,
   MODE_ACTION = 0x1,
   MODE_DELETE_CONFIRM = 0x2,
   MODE_ERROR = 0x3,
+  MODE_LIST = 0x4,
+  NUM_MODES
 };
 
 enum InMsgType {
@@ -105,10 +244,22 @@ enum InMsgType {
   KEY_ACTION_SUPPORT = 0x6,
   KEY_UTC_OFFSET = 0x7,
   KEY_ACCOUNT_ID = 0x8,
+  KEY_MSG_ENCODING = 0xA,
+  KEY_DEBUG_CMD = 0xC,
+  KEY_LOW_POWER_THRESHOLD = 0xE,
+  KEY_ACCOUNT_RESERVE = 0xF,
+  KEY_MSG_PRIORITY = 0x11,
+  KEY_EVICTION_POLICY = 0x12,
+  KEY_SYNC_CMD = 0x14,
 };
 
 enum OutMsgType {
   KEY_CMD = 0x9,
+  KEY_CAPABILITIES = 0xB,
+  KEY_METRICS = 0xD,
+  KEY_ACCOUNT_STATS = 0x10,
+  KEY_DIGEST = 0x13,
+  KEY_LOCAL_TIME = 0x15,
 };
 
 enum OutMsgCommands {
@@ -116,479 +267,1316 @@ enum OutMsgCommands {
   VAL_CMD_REPLY1 = 0x1,
   VAL_CMD_REPLY2 = 0x2,
   VAL_CMD_OPEN = 0x3,
+  VAL_CMD_HELLO = 0x4,
+  VAL_CMD_METRICS = 0x5,
+};
+
+enum DebugCommands {
+  VAL_DEBUG_DUMP_METRICS = 0x0,
+  VAL_DEBUG_RESET_METRICS = 0x1,
+  // Only in builds configured with --debug-commands
+  VAL_DEBUG_INJECT_BUSY = 0x2,
+  VAL_DEBUG_INJECT_REJECT = 0x3,
+  VAL_DEBUG_INJECT_TIMEOUT = 0x4,
+};
+
+// Values of KEY_SYNC_CMD, changes made on the phone. They apply to the
+// message in KEY_MSG_UUID, or else every message of KEY_ACCOUNT_ID, or else
+// every message.
+enum SyncCommands {
+  VAL_SYNC_DELETE = 0x0,
+  VAL_SYNC_MARK_READ = 0x1,
+  VAL_SYNC_CLEAR = 0x2,
 };
 
-enum VibePatterns {
-  VIBE_PATTERN_SHORT = 0x0,
-  VIBE_PATTERN_LONG = 0x1,
-  VIBE_PATTERN_DOUBLE = 0x2,
-} VibePatterns;
+// Values of KEY_EVICTION_POLICY, how a full store picks the message a new one
+// replaces
+enum EvictionPolicies {
+  EVICT_OLDEST = 0x0,
+  EVICT_ACCOUNT_RESERVE = 0x1,
+  EVICT_PRIORITY = 0x2,
+  NUM_EVICTION_POLICIES
+};
+
+// Bits of KEY_CAPABILITIES, sent with VAL_CMD_HELLO at launch
+enum Capabilities {
+  CAPABILITY_TEXT_CODEC = 0x1,
+  CAPABILITY_DIGEST = 0x2,
+};
+
+// KEY_DIGEST, sent with VAL_CMD_HELLO: the store generation and, newest
+// first, a fingerprint of each stored UUID with the generation its slot was
+// last written at and its state. The phone sends only the messages and
+// changes the digest lacks. Only the used entries go on the wire.
+enum DigestStates {
+  DIGEST_DELETED = 0x1,
+  DIGEST_READ = 0x2,
+};
+
+typedef struct digest_entry_t
+{
+  uint32_t fingerprint;
+  uint32_t generation;
+  uint8_t state;
+} __attribute__((__packed__)) digest_entry_t;
+
+typedef struct digest_t
+{
+  uint32_t generation;
+  uint8_t count;
+  digest_entry_t entries[MAX_MESSAGES];
+} __attribute__((__packed__)) digest_t;
+
+// Bits of KEY_MSG_ENCODING. With MSG_ENCODING_CODEC the KEY_MSG_TEXT tuple is
+// a byte array in text_codec format; with MSG_ENCODING_APPEND it continues
+// the body already received instead of replacing it. MSG_ENCODING_MORE says
+// further chunks of the body are on their way.
+enum MsgEncodings {
+  MSG_ENCODING_CODEC = 0x1,
+  MSG_ENCODING_APPEND = 0x2,
+  MSG_ENCODING_MORE = 0x4,
+};
 
 //
 // Handle persistent modes
 //
 
-void handle_error_hide_timer(void *data)
+// Slot holding the index'th newest message in view
+static int8_t slot_at(int8_t index)
 {
-  if( mode == MODE_ERROR )
+  return view[index];
+}
+
+// Slots not read from storage yet stay out of view until the deferred load,
+// rather than showing as empty cards dated 1970
+static void rebuild_view()
+{
+  view_count = 0;
+  for( int8_t i = 0; i < app_metadata.num_messages_filled; i++ )
   {
-    layer_set_hidden(text_layer_get_layer(errorLayer),true);
-    mode = MODE_SCROLL;
-    
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_UP, upArrow);  
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_DOWN, downArrow);
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_SELECT, trash);
+    int8_t slot = app_metadata.order[i];
+    if( !(slots_loaded & SLOT_BIT(slot)) )
+      continue;
+    if( !account_filtered || account_id[slot] == account_filter )
+      view[view_count++] = slot;
+  }
+}
+
+static int8_t account_messages(uint32_t account)
+{
+  int8_t count = 0;
+  for( int8_t i = 0; i < app_metadata.num_messages_filled; i++ )
+  {
+    if( account_id[app_metadata.order[i]] == account )
+      count++;
+  }
+  return count;
+}
+
+static void set_slot_bit(uint8_t *bits, int8_t slot, bool on)
+{
+  if( on )
+    *bits |= SLOT_BIT(slot);
+  else
+    *bits &= ~SLOT_BIT(slot);
+}
+
+// Oldest stored message among the slots in mask, -1 if there is none
+static int8_t oldest_in(uint8_t mask)
+{
+  if( (filled_slots & mask) == 0 )
+    return -1;
+
+  int8_t i = app_metadata.num_messages_filled-1;
+  while( (SLOT_BIT(app_metadata.order[i]) & mask) == 0 )
+    i--;
+  return app_metadata.order[i];
+}
+
+// Slots that would take their account below its reserve if they went.
+// The account a new message is for never needs protecting from itself.
+static uint8_t reserved_slots(uint32_t account)
+{
+  uint8_t reserved = 0;
+  for( int8_t i = 0; i < app_metadata.num_messages_filled; i++ )
+  {
+    int8_t slot = app_metadata.order[i];
+    if( account_id[slot] != account && account_messages(account_id[slot]) <= app_metadata.account_reserve )
+      reserved |= SLOT_BIT(slot);
+  }
+  return reserved;
+}
+
+static int8_t evict_oldest(uint32_t account)
+{
+  return oldest_in(filled_slots);
+}
+
+static int8_t evict_account_reserve(uint32_t account)
+{
+  uint8_t candidates[] = { filled_slots & ~reserved_slots(account), filled_slots };
+  for( uint8_t i = 0; i < sizeof(candidates); i++ )
+  {
+    if( candidates[i] )
+      return oldest_in(candidates[i]);
+  }
+  return -1;
+}
+
+// Deleted messages go first, then read ones, then unread ones. Account
+// reserves outrank read state and priority: a read message its account needs
+// to stay at its reserve goes only once nothing unreserved is left.
+static int8_t evict_priority(uint32_t account)
+{
+  uint8_t normal = filled_slots & ~priority_slots;
+  uint8_t unreserved = filled_slots & ~reserved_slots(account);
+  uint8_t candidates[] = {
+    filled_slots & deleted_slots,
+    normal & read_slots & unreserved,
+    normal & unreserved,
+    unreserved,
+    normal & read_slots,
+    filled_slots,
+  };
+  for( uint8_t i = 0; i < sizeof(candidates); i++ )
+  {
+    if( candidates[i] )
+      return oldest_in(candidates[i]);
   }
+  return -1;
+}
+
+typedef int8_t (*EvictionPolicy)(uint32_t account);
+
+static const EvictionPolicy eviction_policies[NUM_EVICTION_POLICIES] = {
+  [EVICT_OLDEST] = evict_oldest,
+  [EVICT_ACCOUNT_RESERVE] = evict_account_reserve,
+  [EVICT_PRIORITY] = evict_priority,
+};
+
+// Slot a new message from account is written to: a free one, else whichever
+// the eviction policy gives up
+static int8_t store_victim(uint32_t account)
+{
+  if( app_metadata.num_messages_filled < MAX_MESSAGES )
+    return app_metadata.order[app_metadata.num_messages_filled];
+
+  return eviction_policies[app_metadata.eviction_policy](account);
+}
+
+// Makes slot the newest message
+static void store_insert(int8_t slot)
+{
+  int8_t i = 0;
+  while( app_metadata.order[i] != slot )
+    i++;
+
+  if( i >= app_metadata.num_messages_filled )
+    app_metadata.num_messages_filled++;
+  filled_slots |= SLOT_BIT(slot);
+
+  for( ; i > 0; i-- )
+    app_metadata.order[i] = app_metadata.order[i-1];
+  app_metadata.order[0] = slot;
+}
+
+// Drops the message in slot, freeing the slot for the next one
+static void store_remove(int8_t slot)
+{
+  int8_t i = 0;
+  while( app_metadata.order[i] != slot )
+    i++;
+
+  for( ; i < MAX_MESSAGES-1; i++ )
+    app_metadata.order[i] = app_metadata.order[i+1];
+  app_metadata.order[MAX_MESSAGES-1] = slot;
+  app_metadata.num_messages_filled--;
+
+  uint8_t bits = ~SLOT_BIT(slot);
+  filled_slots &= bits;
+  deleted_slots &= bits;
+  read_slots &= bits;
+  priority_slots &= bits;
+  unsaved_slots &= bits;
+  uuid_text[slot][0] = '\0';
+
+  persist_delete(PERSIST_KEY_MESSAGE(slot));
+  persist_delete(PERSIST_KEY_MESSAGE(slot)+1);
+  app_metadata.generation++;
+  app_metadata.slot_generation[slot] = app_metadata.generation;
+}
+
+static int8_t current_slot()
+{
+  return slot_at(cursor);
+}
+
+// Index in view of the message in slot, -1 if it is not in view
+static int8_t card_of(int8_t slot)
+{
+  for( int8_t index = 0; index < view_count; index++ )
+  {
+    if( view[index] == slot )
+      return index;
+  }
+  return -1;
+}
+
+// A message counts as read once someone has had it on screen
+static void mark_read(int8_t slot)
+{
+  if( !user_active || (read_slots & SLOT_BIT(slot)) )
+    return;
+  read_slots |= SLOT_BIT(slot);
+  unsaved_slots |= SLOT_BIT(slot);
+}
+
+static int16_t measure_body(int8_t slot)
+{
+  if( body_height[slot] == 0 )
+  {
+    GSize size = graphics_text_layout_get_content_size(scroll_text[slot], body_font, GRect(0,0,body_box.w,body_box.h),
+                                                      GTextOverflowModeFill, GTextAlignmentLeft);
+    // Leave room for descenders on the last line
+    body_height[slot] = size.h + 4 < body_box.h ? size.h + 4 : body_box.h;
+  }
+  return body_height[slot];
+}
+
+static int16_t card_height(int8_t card)
+{
+  if( card >= view_count )
+    return 0;
+  return CARD_BODY_TOP + measure_body(slot_at(card)) + CARD_FOOTER_HEIGHT;
+}
+
+// Moves a card's layer to its offset, hiding cards past the stored messages.
+// Cards already in place are left alone.
+static void place_card(int8_t card)
+{
+  Layer *layer = card_layer[card];
+  GRect frame = layer_get_frame(layer);
+  int16_t height = card_offset[card+1]-card_offset[card];
+  bool hidden = card >= view_count;
+
+  if( frame.origin.y == card_offset[card] && frame.size.h == height && layer_get_hidden(layer) == hidden )
+    return;
+
+  frame.origin.y = card_offset[card];
+  frame.size.h = height;
+  layer_set_frame(layer, frame);
+  layer_set_hidden(layer, hidden);
+  metrics_count(METRIC_LAYER_UPDATES, 1);
+}
+
+// Scrolls so content offset y is at the top of the screen
+static void scroll_to(int16_t y, bool animated)
+{
+  if( y > content_height-page_height )
+    y = content_height-page_height;
+  if( y < 0 )
+    y = 0;
+  if( y == scroll_y )
+    return;
+
+  scroll_y = y;
+  scroll_layer_set_content_offset(scroll_layer, GPoint(0,-y), animated && !power_is_low());
+}
+
+// Recomputes card offsets from card `from` on, after its height changed or
+// the cards were refilled, and keeps the card being read where it was.
+static void layout_cards(int8_t from)
+{
+  int16_t anchor = card_offset[cursor];
+
+  for( int8_t card = from; card < MAX_MESSAGES; card++ )
+  {
+    card_offset[card+1] = card_offset[card] + card_height(card);
+    place_card(card);
+  }
+
+  // Room below the last card for it to scroll to the top, so the card acted
+  // on is always the one at the top of the screen
+  int8_t last = view_count > 0 ? view_count-1 : 0;
+  int16_t height = card_offset[last] + page_height;
+  if( height < card_offset[MAX_MESSAGES] )
+    height = card_offset[MAX_MESSAGES];
+
+  if( height != content_height )
+  {
+    content_height = height;
+    GRect frame = layer_get_frame(scroll_layer_get_layer(scroll_layer));
+    scroll_layer_set_content_size(scroll_layer, GSize(frame.size.w, content_height));
+  }
+
+  scroll_to(scroll_y + card_offset[cursor] - anchor, false);
+}
+
+// Card at content offset y, by binary search over the card offsets
+static int8_t card_at(int16_t y)
+{
+  int8_t low = 0;
+  int8_t high = view_count-1;
+  while( low < high )
+  {
+    int8_t mid = (low+high+1)/2;
+    if( card_offset[mid] <= y )
+      low = mid;
+    else
+      high = mid-1;
+  }
+  return low;
+}
+
+// Moves the cursor, clamped to the stored messages, and scrolls its card to
+// the top of the screen
+static void set_cursor(int8_t index, bool animated)
+{
+  if( index > view_count-1 )
+    index = view_count-1;
+  if( index < 0 )
+    index = 0;
+
+  cursor = index;
+  scroll_to(card_offset[cursor], animated);
+  if( view_count > 0 )
+    mark_read(current_slot());
+  if( mode == MODE_LIST )
+    layer_mark_dirty(list_layer);
+}
+
+// Switches mode, showing the matching overlay and action bar icons. Icons are
+// only touched when the set actually changes.
+static void set_mode(uint8_t new_mode)
+{
+  if( new_mode == mode )
+    return;
+
+  mode = new_mode;
+  layer_set_hidden(text_layer_get_layer(deleteConfirmLayer), mode != MODE_DELETE_CONFIRM);
+  layer_set_hidden(text_layer_get_layer(errorLayer), mode != MODE_ERROR);
+  layer_set_hidden(list_layer, mode != MODE_LIST);
+
+  // The confirm and error overlays keep whichever icons were showing
+  if( (mode == MODE_SCROLL || mode == MODE_ACTION || mode == MODE_LIST) && mode != icon_mode )
+  {
+    icon_mode = mode;
+    if( mode == MODE_SCROLL || mode == MODE_LIST )
+    {
+      action_bar_layer_set_icon(action_bar, BUTTON_ID_UP, upArrow);  
+      action_bar_layer_set_icon(action_bar, BUTTON_ID_DOWN, downArrow);
+      action_bar_layer_set_icon(action_bar, BUTTON_ID_SELECT, mode == MODE_LIST ? open : trash);
+    }
+    else
+    {
+      action_bar_layer_set_icon(action_bar, BUTTON_ID_UP, reply1);
+      action_bar_layer_set_icon(action_bar, BUTTON_ID_DOWN, reply2);
+      action_bar_layer_set_icon(action_bar, BUTTON_ID_SELECT, open);
+    }
+    metrics_count(METRIC_ICON_SETS, 3);
+  }
+}
+
+void handle_error_hide_timer(void *data)
+{
+  if( mode == MODE_ERROR )
+    set_mode(MODE_SCROLL);
   error_hide_timer = NULL;
 }
 
-void reschedule_kill_timer() {
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Resetting kill timer");
-  light_enable_interaction();
+static uint32_t kill_timeout() {
+  return user_active ? KILL_TIMEOUT_MS : KILL_TIMEOUT_IDLE_MS;
+}
+
+void reschedule_kill_timer(bool user_input) {
+  LOG_DEBUG(LOG_CAT_APP, "Resetting kill timer");
+  power_light_interaction(user_input);
+  if( user_input )
+    user_active = 1;
+  kill_extensions = 0;
   if( kill_timer != NULL )
-    app_timer_reschedule(kill_timer, 30*1000);
+    app_timer_reschedule(kill_timer, kill_timeout());
+}
+
+// Draws the summary list straight from the store, one row per message with
+// the cursor's row inverted and scrolled into view
+static void list_update_proc(Layer *layer, GContext *ctx)
+{
+  GRect bounds = layer_get_bounds(layer);
+  graphics_context_set_fill_color(ctx, GColorWhite);
+  graphics_fill_rect(ctx, bounds, 0, GCornerNone);
+
+  int8_t rows = bounds.size.h / LIST_ROW_HEIGHT;
+  int8_t first = cursor >= rows ? cursor-rows+1 : 0;
+  int16_t width = bounds.size.w-ACTION_BAR_WIDTH-22;
+
+  for( int8_t index = first; index < view_count && index < first+rows; index++ )
+  {
+    int8_t slot = slot_at(index);
+    GRect row = GRect(0,(index-first)*LIST_ROW_HEIGHT,bounds.size.w-ACTION_BAR_WIDTH,LIST_ROW_HEIGHT);
+
+    if( index == cursor )
+    {
+      graphics_context_set_fill_color(ctx, GColorBlack);
+      graphics_fill_rect(ctx, row, 0, GCornerNone);
+      graphics_context_set_text_color(ctx, GColorWhite);
+      graphics_context_set_compositing_mode(ctx, GCompOpAssignInverted);
+    }
+    else
+    {
+      graphics_context_set_text_color(ctx, GColorBlack);
+      graphics_context_set_compositing_mode(ctx, GCompOpAssign);
+    }
+
+    graphics_draw_bitmap_in_rect(ctx, (deleted_slots & SLOT_BIT(slot)) ? deleted_bubble : bubble, GRect(2,row.origin.y+3,14,14));
+    graphics_draw_text(ctx, from_text[slot], bold_font, GRect(20,row.origin.y-2,width,18),
+                       GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft, NULL);
+    graphics_draw_text(ctx, subject_text[slot], body_font, GRect(20,row.origin.y+14,width,18),
+                       GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft, NULL);
+  }
+  metrics_count(METRIC_LAYER_UPDATES, 1);
+}
+
+// Draws a whole message card: bubble, age, sender, subject, body and footer
+static void card_update_proc(Layer *layer, GContext *ctx)
+{
+  int8_t slot = slot_at(*(int8_t*)layer_get_data(layer));
+  int16_t height = measure_body(slot);
+  GRect bounds = layer_get_bounds(layer);
+
+  if( slot == render_pending_slot )
+  {
+    metrics_record_time(TIMER_NOTIFY_RENDER, render_start);
+    render_pending_slot = -1;
+  }
+
+  graphics_context_set_fill_color(ctx, GColorWhite);
+  graphics_fill_rect(ctx, bounds, 0, GCornerNone);
+  graphics_context_set_text_color(ctx, GColorBlack);
+  graphics_context_set_compositing_mode(ctx, GCompOpAssign);
+
+  graphics_draw_bitmap_in_rect(ctx, (deleted_slots & SLOT_BIT(slot)) ? deleted_bubble : bubble, GRect(20,2,14,14));
+  graphics_draw_text(ctx, header_text[slot], body_font, GRect(40,0,bounds.size.w-50-5,18),
+                     GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft, NULL);
+  graphics_draw_text(ctx, from_text[slot], bold_font, GRect(2,CARD_FROM_TOP,body_box.w,16),
+                     GTextOverflowModeTrailingEllipsis, GTextAlignmentLeft, NULL);
+  graphics_draw_text(ctx, subject_text[slot], bold_font, GRect(2,CARD_SUBJECT_TOP,body_box.w,30),
+                     GTextOverflowModeFill, GTextAlignmentLeft, NULL);
+  graphics_draw_text(ctx, scroll_text[slot], body_font, GRect(2,CARD_BODY_TOP,body_box.w,height),
+                     GTextOverflowModeFill, GTextAlignmentLeft, NULL);
+  graphics_draw_text(ctx, footer_text[slot], bold_font, GRect(2,CARD_BODY_TOP+height,body_box.w,CARD_FOOTER_HEIGHT),
+                     GTextOverflowModeTrailingEllipsis, GTextAlignmentCenter, NULL);
+}
+
+// Redraws the one message in slot after a change that keeps its size
+static void redraw_slot(int8_t slot)
+{
+  int8_t card = card_of(slot);
+  if( card < 0 )
+    return;
+
+  layer_mark_dirty(card_layer[card]);
+  if( mode == MODE_LIST )
+    layer_mark_dirty(list_layer);
+  metrics_count(METRIC_LAYER_UPDATES, 1);
+}
+
+// Watch clock as UTC. Message times are UTC from the phone, so this is the
+// only place the phone's offset is applied.
+static time_t utc_now()
+{
+  return time(NULL)-app_metadata.utc_offset;
+}
+
+// Writes a new offset into the persisted metadata straight away rather than
+// on exit, so a launch after a crash still ages messages right. Only the
+// offset changes: the rest of the saved record has to keep matching the
+// message records saved with it.
+static void save_utc_offset()
+{
+  app_data_t saved = app_metadata;
+  if( persist_exists(PERSIST_KEY_METADATA) )
+  {
+    persist_read_data(PERSIST_KEY_METADATA, &saved, sizeof(app_data_t));
+  }
+  else
+  {
+    saved.num_messages_filled = 0;
+    saved.next_write_index = 0;
+    saved.order[0] = -1;
+  }
+  saved.utc_offset = app_metadata.utc_offset;
+  persist_write_data(PERSIST_KEY_METADATA, &saved, sizeof(app_data_t));
+  metrics_count(METRIC_PERSIST_WRITES, 1);
+  metrics_count(METRIC_PERSIST_BYTES, sizeof(app_data_t));
+}
+
+static void format_age(char *text, time_t age)
+{
+  if( age < 2*60 )
+  {
+    strcpy(text,"Just Now");
+  }
+  else if( age < 60*60 )
+  {
+    time_t minutes = age / 60;
+    snprintf(text,MAX_TEXT_LENGTH,"%d Minutes Ago",(int)minutes);
+  }
+  else if( age < 2*60*60 )
+  {
+    strcpy(text,"An Hour Ago");
+  }
+  else if( age < 24*60*60 )
+  {
+    time_t hours = age/60/60;
+    snprintf(text,MAX_TEXT_LENGTH,"%d Hours Ago",(int)hours);
+  }
+  else
+  {
+    time_t days = age/60/60/24;
+    snprintf(text,MAX_TEXT_LENGTH,"%d Days Ago",(int)days);
+  }
+}
+
+// Rewrites the age of each message in view against one reading of the
+// clock, redrawing only the cards whose text changed
+static void update_ages()
+{
+  time_t now = utc_now();
+  char text[MAX_TEXT_LENGTH];
+
+  for( int8_t index = 0; index < view_count; index++ )
+  {
+    int8_t slot = slot_at(index);
+    format_age(text, now - header_time[slot]);
+    if( strcmp(text, header_text[slot]) == 0 )
+      continue;
+
+    strcpy(header_text[slot], text);
+    layer_mark_dirty(card_layer[index]);
+    metrics_count(METRIC_LAYER_UPDATES, 1);
+  }
 }
 
 void refresh_screen() {
-    if( app_metadata.num_messages_filled == MAX_MESSAGES )
+    uint32_t start = metrics_now();
+    metrics_count(METRIC_REFRESH_CALLS, 1);
+
+    rebuild_view();
+
+    for( int8_t writeIndex = 0; writeIndex < view_count; writeIndex++ )
     {
-      int8_t startIndex = app_metadata.next_write_index-1;
-      if( startIndex < 0 )
-        startIndex = MAX_MESSAGES-1;
-      
-      int8_t iterator = startIndex;
+      int8_t slot = slot_at(writeIndex);
+      LOG_DEBUG(LOG_CAT_UI, "Updating UI index %d with data from %d...",writeIndex,slot);
+
+      snprintf(footer_text[slot],MAX_TEXT_LENGTH,"%d / %d",writeIndex+1,account_filtered ? view_count : app_metadata.num_messages_filled);
+      header_text[slot][0] = '\0';
+    }
+
+    // Every card in view is redrawn here, new ages included
+    update_ages();
+    layout_cards(0);
+    if( mode == MODE_LIST )
+      layer_mark_dirty(list_layer);
+    metrics_record_time(TIMER_REFRESH, start);
+}
+
+// Stores text at dest, encoded when that is smaller. Returns the bytes used
+// and sets flag in flags if the stored form is encoded.
+static uint8_t pack_text(const char *text, uint8_t *dest, size_t dest_size, uint8_t *flags, uint8_t flag)
+{
+  size_t raw_length = strlen(text);
+  if( raw_length > dest_size )
+    raw_length = dest_size;
+
+  int encoded_length = text_codec_encode(text, dest, raw_length);
+  if( encoded_length >= 0 && (size_t)encoded_length < raw_length )
+  {
+    *flags |= flag;
+    return encoded_length;
+  }
+
+  memcpy(dest, text, raw_length);
+  return raw_length;
+}
+
+static void unpack_text(const uint8_t *src, uint8_t length, uint8_t flags, uint8_t flag, char *dest)
+{
+  if( flags & flag )
+  {
+    text_codec_decode(src, length, dest, MAX_TEXT_LENGTH);
+  }
+  else
+  {
+    if( length > MAX_TEXT_LENGTH-1 )
+      length = MAX_TEXT_LENGTH-1;
+    memcpy(dest, src, length);
+    dest[length] = '\0';
+  }
+}
+
+void persist_messages(int8_t index)
+{
+  LOG_DEBUG(LOG_CAT_STORE, "Persisting current messages for index %d...",index);
+  uint32_t start = metrics_now();
+  message_1_t msg1;
+  message_2_t msg2;
+
+  for( int8_t i = 0; i < MAX_MESSAGES; i++ )
+  {
+    if( index != -1 && index != i )
+      continue;
+
+    msg1.header_time = header_time[i];
+    msg1.account_id = account_id[i];
+    msg1.deleted = (deleted_slots & SLOT_BIT(i)) != 0;
+    msg1.flags = 0;
+    if( read_slots & SLOT_BIT(i) )
+      msg1.flags |= PERSIST_READ;
+    if( priority_slots & SLOT_BIT(i) )
+      msg1.flags |= PERSIST_PRIORITY;
+    msg1.uuid_length = pack_text(uuid_text[i], msg1.data, MAX_TEXT_LENGTH-11, &msg1.flags, PERSIST_UUID_ENCODED);
+    msg1.text_length = pack_text(scroll_text[i], &msg1.data[msg1.uuid_length], sizeof(msg1.data)-msg1.uuid_length, &msg1.flags, PERSIST_TEXT_ENCODED);
+
+    msg2.flags = 0;
+    msg2.from_length = pack_text(from_text[i], msg2.data, MAX_TEXT_LENGTH-1, &msg2.flags, PERSIST_FROM_ENCODED);
+    msg2.subject_length = pack_text(subject_text[i], &msg2.data[msg2.from_length], sizeof(msg2.data)-msg2.from_length, &msg2.flags, PERSIST_SUBJECT_ENCODED);
+
+    unsaved_slots &= ~SLOT_BIT(i);
+    app_metadata.generation++;
+    app_metadata.slot_generation[i] = app_metadata.generation;
+    size_t size1 = offsetof(message_1_t, data)+msg1.uuid_length+msg1.text_length;
+    size_t size2 = offsetof(message_2_t, data)+msg2.from_length+msg2.subject_length;
+    persist_write_data(PERSIST_KEY_MESSAGE(i), &msg1, size1);
+    persist_write_data(PERSIST_KEY_MESSAGE(i)+1, &msg2, size2);
+    metrics_count(METRIC_PERSIST_WRITES, 2);
+    metrics_count(METRIC_PERSIST_BYTES, size1+size2);
+    LOG_VERBOSE(LOG_CAT_STORE, "Saved message with subject: %s",subject_text[i]);
+    LOG_VERBOSE(LOG_CAT_STORE, "Saved message text: %s",scroll_text[i]);
+  }
+  metrics_record_time(TIMER_PERSIST, start);
+  LOG_DEBUG(LOG_CAT_STORE, "Persisting complete.");
+}
+
+//
+// Handle AppMessage
+//
+
+// Pause before resending a command, long enough for whatever holds the
+// outbox (usually the launch hello) to finish
+#define COMMAND_RETRY_MS 250
+#define COMMAND_MAX_RETRIES 3
+
+static void command_failed(AppMessageResult reason);
+void load_messages();
+static void finish_deferred_load();
+
+// (Re)sends the command held in msg_cmd, msg_account and msg_uuid. Failing to
+// even queue it goes through the same retries as a failed delivery.
+static void send_pending_command()
+{
+#ifdef DEBUG_COMMANDS
+  if( injected_failures > 0 )
+  {
+    AppMessageResult failure = injected_failure[0];
+    injected_failures--;
+    memmove(&injected_failure[0], &injected_failure[1], injected_failures*sizeof(injected_failure[0]));
+    command_failed(failure);
+    return;
+  }
+#endif
+
+  DictionaryIterator *iter;
+  AppMessageResult result = app_message_outbox_begin(&iter);
+  if( result == APP_MSG_OK )
+  {
+    Tuplet value = TupletInteger(KEY_CMD, msg_cmd);
+    dict_write_tuplet(iter, &value);
+    Tuplet acct = TupletInteger(KEY_ACCOUNT_ID, msg_account);
+    dict_write_tuplet(iter, &acct);
+    Tuplet msg = TupletCString(KEY_MSG_UUID, &msg_uuid[0]);
+    dict_write_tuplet(iter,&msg);
+    result = app_message_outbox_send();
+  }
+
+  if( result != APP_MSG_OK )
+  {
+    LOG_WARNING(LOG_CAT_MSG, "Failed to queue outgoing message: %d",result);
+    command_failed(result);
+  }
+}
+
+static void handle_command_retry(void *data)
+{
+  send_pending_command();
+}
+
+static void send_command(int cmd, int8_t slot)
+{
+  // The slot is persisted again once the command completes, and the rest of
+  // the store has to be in view once loaded
+  finish_deferred_load();
+
+  actions_enabled = 0;
+  hide_actionbar(action_bar);
+  msg_cmd = cmd;
+  msg_account = (uint32_t)account_id[slot];
+  strcpy(msg_uuid,uuid_text[slot]);
+  msg_send_index = slot;
+  metrics_count(METRIC_COMMANDS, 1);
+  command_start = metrics_now();
+
+  send_pending_command();
+}
+
+// Whether a delivered or failed outbox dictionary was a hello or metrics
+// message rather than a command. Both kinds go through the one outbox, so
+// only the dictionary itself can tell.
+static bool is_service_message(DictionaryIterator *iter)
+{
+  Tuple *cmd = iter ? dict_find(iter, KEY_CMD) : NULL;
+  return cmd && (cmd->value->int32 == VAL_CMD_HELLO || cmd->value->int32 == VAL_CMD_METRICS);
+}
+
+void out_sent_handler(DictionaryIterator *sent, void *context) {
+   // outgoing message was delivered
+   LOG_DEBUG(LOG_CAT_MSG, "Outgoing message was delivered successfully.");
+   if( is_service_message(sent) )
+   {
+     service_in_flight = 0;
+     return;
+   }
+
+   metrics_count(METRIC_OUTBOX_SENT, 1);
+   metrics_record_time(TIMER_COMMAND_ACK, command_start);
+   retries = 0;
+   actions_enabled = 1;
+   show_actionbar(action_bar);
+  
+   // Any completed command retires the message on the watch, unless the
+   // phone removed or replaced it while the command was out
+   if( !(filled_slots & SLOT_BIT(msg_send_index)) || strcmp(uuid_text[msg_send_index], msg_uuid) != 0 )
+     return;
+   if( msg_cmd == VAL_CMD_DELETE )
+     accounts_count(account_id[msg_send_index], ACCOUNT_DELETED);
+   deleted_slots |= SLOT_BIT(msg_send_index);
+   persist_messages(msg_send_index);
+   redraw_slot(msg_send_index);
+}
+
+
+// Retries a command that could not be queued or delivered a few times, then
+// gives up and shows why
+static void command_failed(AppMessageResult reason)
+{
+  metrics_count_failure(reason);
+
+  const char *error = "An unknown error occurred.";
+  bool retry = false;
+
+  switch(reason)
+  {
+    case APP_MSG_ALREADY_RELEASED:
+    LOG_DEBUG(LOG_CAT_MSG, "Already Released");
+    break;
+
+    case APP_MSG_BUFFER_OVERFLOW:
+    LOG_DEBUG(LOG_CAT_MSG, "Buffer Overflow");
+    break;
+
+    case APP_MSG_BUSY:
+    LOG_DEBUG(LOG_CAT_MSG, "Busy");
+    retry = true;
+    error = "Too busy to send command.";
+    break;
+
+    case APP_MSG_INVALID_ARGS:
+    LOG_DEBUG(LOG_CAT_MSG, "Invalid Args");
+    break;
+
+    case APP_MSG_NOT_CONNECTED:
+    LOG_DEBUG(LOG_CAT_MSG, "Not Connected");
+    error = "Not connected to watch.";
+    break;
+
+    case APP_MSG_OUT_OF_MEMORY:
+    LOG_DEBUG(LOG_CAT_MSG, "Out of Memory");
+    error = "Out of memory.";
+    break;
+
+    case APP_MSG_SEND_REJECTED:
+    LOG_DEBUG(LOG_CAT_MSG, "Send Rejected");
+    retry = true;
+    error = "Message rejected.";
+    break;
+
+    case APP_MSG_SEND_TIMEOUT:
+    LOG_DEBUG(LOG_CAT_MSG, "Send Timeout");
+    retry = true;
+    error = "Message timed out.";
+    break;
+
+    default:
+    break;
+  }
+
+  if( retry && retries < COMMAND_MAX_RETRIES )
+  {
+    retries++;
+    metrics_count(METRIC_OUTBOX_RETRIES, 1);
+    app_timer_register(COMMAND_RETRY_MS, handle_command_retry, NULL);
+    return;
+  }
+
+  text_layer_set_text(errorConfirmationTextLayer, error);
+  retries = 0;
+  actions_enabled = 1;
+  show_actionbar(action_bar);
+
+  set_mode(MODE_ERROR);
+  error_hide_timer = app_timer_register(3*1000, handle_error_hide_timer, NULL);
+}
+
+void out_failed_handler(DictionaryIterator *failed, AppMessageResult reason, void *context) {
+  // outgoing message failed  
+   LOG_WARNING(LOG_CAT_MSG, "Failed to send outgoing message: %d",reason);
+   if( is_service_message(failed) )
+   {
+     // Service messages are best effort; without the hello the phone just
+     // keeps sending plain text
+     service_in_flight = 0;
+     return;
+   }
+
+   command_failed(reason);
+}
+
+// 32 bit FNV-1a
+static uint32_t fingerprint(const char *text)
+{
+  uint32_t hash = 2166136261u;
+  while( *text )
+  {
+    hash ^= (uint8_t)*text++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
 
-      int8_t writeIndex = 0;
-      while( writeIndex < MAX_MESSAGES )
+static void write_digest(DictionaryIterator *iter)
+{
+  digest_t digest;
+  digest.generation = app_metadata.generation;
+  digest.count = app_metadata.num_messages_filled;
+
+  for( int8_t i = 0; i < app_metadata.num_messages_filled; i++ )
+  {
+    int8_t slot = app_metadata.order[i];
+    digest_entry_t *entry = &digest.entries[i];
+    entry->fingerprint = fingerprint(uuid_text[slot]);
+    entry->generation = app_metadata.slot_generation[slot];
+    entry->state = 0;
+    if( deleted_slots & SLOT_BIT(slot) )
+      entry->state |= DIGEST_DELETED;
+    if( read_slots & SLOT_BIT(slot) )
+      entry->state |= DIGEST_READ;
+  }
+
+  dict_write_data(iter, KEY_DIGEST, (const uint8_t*)&digest, offsetof(digest_t, entries)+digest.count*sizeof(digest_entry_t));
+}
+
+// Hello and metrics messages go out beside the command and retry flow. The
+// hello tells the phone which optional protocol features this build supports
+// and, once the store is loaded, what it already holds.
+static void send_service_message(int cmd)
+{
+  DictionaryIterator *iter;
+  if( app_message_outbox_begin(&iter) != APP_MSG_OK )
+    return;
+
+  Tuplet value = TupletInteger(KEY_CMD, cmd);
+  dict_write_tuplet(iter, &value);
+  if( cmd == VAL_CMD_HELLO )
+  {
+    Tuplet capabilities = TupletInteger(KEY_CAPABILITIES, (uint32_t)(CAPABILITY_TEXT_CODEC | CAPABILITY_DIGEST));
+    dict_write_tuplet(iter, &capabilities);
+    write_digest(iter);
+    // Lets the phone send KEY_UTC_OFFSET whenever the watch's idea of it has
+    // gone stale, as it does across DST changes and time zones
+    Tuplet local_time = TupletInteger(KEY_LOCAL_TIME, (int32_t)time(NULL));
+    dict_write_tuplet(iter, &local_time);
+  }
+  else if( cmd == VAL_CMD_METRICS )
+  {
+    metrics_write(iter, KEY_METRICS);
+    accounts_write(iter, KEY_ACCOUNT_STATS);
+  }
+
+  if( app_message_outbox_send() == APP_MSG_OK )
+    service_in_flight = 1;
+}
+
+// Copies a text tuple into dest, truncated to fit dest_size including the
+// terminator and cut at any NUL inside it. A missing tuple copies as empty.
+// Returns the number of characters copied.
+static size_t copy_tuple_text(char *dest, size_t dest_size, const Tuple *tuple)
+{
+  if( dest_size == 0 )
+    return 0;
+  if( tuple == NULL || (tuple->type != TUPLE_CSTRING && tuple->type != TUPLE_BYTE_ARRAY) )
+  {
+    dest[0] = '\0';
+    return 0;
+  }
+
+  size_t length = tuple->length;
+  if( tuple->type == TUPLE_CSTRING && length > 0 )
+    length--;
+  if( length > dest_size-1 )
+    length = dest_size-1;
+
+  memcpy(dest, tuple->value->data, length);
+  dest[length] = '\0';
+  return strlen(dest);
+}
+
+// Integer value of a tuple in whichever width the phone sent it, or fallback
+// for a missing or non-integer tuple
+static int32_t tuple_int(const Tuple *tuple, int32_t fallback)
+{
+  if( tuple == NULL || (tuple->type != TUPLE_INT && tuple->type != TUPLE_UINT) )
+    return fallback;
+
+  bool is_signed = tuple->type == TUPLE_INT;
+  switch( tuple->length )
+  {
+    case 1: return is_signed ? tuple->value->int8 : tuple->value->uint8;
+    case 2: return is_signed ? tuple->value->int16 : tuple->value->uint16;
+    case 4: return tuple->value->int32;
+    default: return fallback;
+  }
+}
+
+// Applies a change made on the phone. Deletes and reads only touch the
+// matching slots; a clear frees them and lays the view out again.
+static void apply_sync(uint8_t command, const char *uuid, const Tuple *account_tuple)
+{
+  bool removed = false;
+
+  // Oldest first, so a removal only shifts entries already visited
+  for( int8_t i = app_metadata.num_messages_filled-1; i >= 0; i-- )
+  {
+    int8_t slot = app_metadata.order[i];
+    if( uuid && strcmp(uuid_text[slot], uuid) != 0 )
+      continue;
+    if( !uuid && account_tuple && account_id[slot] != (uint32_t)tuple_int(account_tuple, 0) )
+      continue;
+
+    switch( command )
+    {
+      case VAL_SYNC_DELETE:
+      if( !(deleted_slots & SLOT_BIT(slot)) )
+      {
+        deleted_slots |= SLOT_BIT(slot);
+        persist_messages(slot);
+        redraw_slot(slot);
+      }
+      break;
+
+      case VAL_SYNC_MARK_READ:
+      // Not drawn, and saved with the rest of the read state on exit
+      if( !(read_slots & SLOT_BIT(slot)) )
       {
-        APP_LOG(APP_LOG_LEVEL_DEBUG, "Updating UI index %d with data from %d...",writeIndex,iterator);
-
-        snprintf(footer_text[iterator],MAX_TEXT_LENGTH,"%d / %d",writeIndex+1,app_metadata.num_messages_filled);
-        
-        time_t emailTime = header_time[iterator];
-        time_t now = time(NULL)-app_metadata.utc_offset;
-     
-        time_t age = now - emailTime;
-        if( age < 2*60 )
-        {
-          strcpy(header_text[iterator],"Just Now");
-        }
-        else if( age < 60*60 )
-        {
-          time_t minutes = age / 60;
-          snprintf(header_text[iterator],MAX_TEXT_LENGTH,"%d Minutes Ago",(int)minutes);
-        }
-        else if( age < 2*60*60 )
-        {
-          strcpy(header_text[iterator],"An Hour Ago");
-        }
-        else if( age < 24*60*60 )
-        {
-          time_t hours = age/60/60;
-          snprintf(header_text[iterator],MAX_TEXT_LENGTH,"%d Hours Ago",(int)hours);
-        }
-        else
-        {
-          time_t days = age/60/60/24;
-          snprintf(header_text[iterator],MAX_TEXT_LENGTH,"%d Days Ago",(int)days);
-        }
-
-        text_layer_set_text(from_text_layer[writeIndex],from_text[iterator]);
-        text_layer_set_text(subject_text_layer[writeIndex],subject_text[iterator]);
-        text_layer_set_text(text_layer[writeIndex],scroll_text[iterator]);
-        text_layer_set_text(header_text_layer[writeIndex], header_text[iterator]);
-        text_layer_set_text(footer_text_layer[writeIndex], footer_text[iterator]);
-
-        if( deleted[iterator] )
-          bitmap_layer_set_bitmap(header_bubble_layer[writeIndex], deleted_bubble);
-        else
-          bitmap_layer_set_bitmap(header_bubble_layer[writeIndex], bubble);
-        
-        writeIndex++;
-        iterator--;
-        if( iterator < 0 ) 
-          iterator = MAX_MESSAGES-1;
+        read_slots |= SLOT_BIT(slot);
+        unsaved_slots |= SLOT_BIT(slot);
       }
+      break;
+
+      case VAL_SYNC_CLEAR:
+      store_remove(slot);
+      removed = true;
+      break;
+
+      default:
+      break;
     }
-    else
-    {
-      int8_t writeIndex = 0;
-      for( int8_t i = app_metadata.num_messages_filled-1; i >= 0; i-- )
-      {
-        snprintf(footer_text[i],MAX_TEXT_LENGTH,"%d / %d",writeIndex+1,app_metadata.num_messages_filled);
-
-
-        time_t emailTime = header_time[i];
-        time_t now = time(NULL)-app_metadata.utc_offset;
-     
-        time_t age = now - emailTime;
-        if( age < 2*60 )
-        {
-          strcpy(header_text[i],"Just Now");
-        }
-        else if( age < 60*60 )
-        {
-          time_t minutes = age / 60;
-          snprintf(header_text[i],MAX_TEXT_LENGTH,"%d Minutes Ago",(int)minutes);
-        }
-        else if( age < 2*60*60 )
-        {
-          strcpy(header_text[i],"An Hour Ago");
-        }
-        else if( age < 24*60*60 )
-        {
-          time_t hours = age/60/60;
-          snprintf(header_text[i],MAX_TEXT_LENGTH,"%d Hours Ago",(int)hours);
-        }
-        else
-        {
-          time_t days = age/60/60/24;
-          snprintf(header_text[i],MAX_TEXT_LENGTH,"%d Days Ago",(int)days);
-        }
-
-        text_layer_set_text(from_text_layer[writeIndex],from_text[i]);
-        text_layer_set_text(subject_text_layer[writeIndex],subject_text[i]);
-        text_layer_set_text(text_layer[writeIndex],scroll_text[i]);
-        text_layer_set_text(header_text_layer[writeIndex], header_text[i]);
-        text_layer_set_text(footer_text_layer[writeIndex], footer_text[i]);
-
-        if( deleted[i] )
-          bitmap_layer_set_bitmap(header_bubble_layer[writeIndex], deleted_bubble);
-        else
-          bitmap_layer_set_bitmap(header_bubble_layer[writeIndex], bubble);
-
-        writeIndex++;
-      }
-    }  
+  }
+
+  if( removed )
+  {
+    refresh_screen();
+    set_cursor(cursor, false);
+  }
 }
 
-void persist_messages(int8_t index)
+// Loads the slots a phone launch skipped and shows them. Dedup and ring
+// writes need the whole store in memory, so the first message received does
+// this if the deferred load timer hasn't yet.
+static void finish_deferred_load()
 {
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Persisting current messages for index %d...",index);
-  message_1_t msg1;
-  message_2_t msg2;
-  
-  strcpy(msg1.scroll_text,"");
-  strcpy(msg2.from_text,"");
-  strcpy(msg2.subject_text,"");
-  strcpy(msg1.uuid_text,"");
-  
-  if( index == -1 || index == 0 )
+  if( slots_loaded != ALL_SLOTS_LOADED )
   {
-    strcpy(msg1.scroll_text,scroll_text[0]);
-    msg1.header_time = header_time[0];
-    strcpy(msg2.from_text,from_text[0]);
-    strcpy(msg2.subject_text,subject_text[0]);
-    strcpy(msg1.uuid_text,uuid_text[0]);
-    msg1.account_id = account_id[0];
-    msg1.deleted = deleted[0];
-    persist_write_data(0x10, &msg1, sizeof(message_1_t));
-    persist_write_data(0x11, &msg2, sizeof(message_2_t));
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Saved message with subject: %s",msg2.subject_text);
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Saved message text: %s",msg1.scroll_text);
+    load_messages();
+    refresh_screen();
   }
+}
+
+static void process_inbound(DictionaryIterator *iter) {
   
-  if( index == -1 || index == 1 )
+  Tuple *uuid_tuple = NULL;
+  Tuple *offset_tuple = NULL;
+  Tuple *time_tuple = NULL;
+  Tuple *from_tuple = NULL;
+  Tuple *subject_tuple = NULL;
+  Tuple *text_tuple = NULL;
+  Tuple *vibe_pattern_tuple = NULL;
+  Tuple *action_support_tuple = NULL;
+  Tuple *account_id_tuple = NULL;
+  Tuple *encoding_tuple = NULL;
+  Tuple *debug_tuple = NULL;
+  Tuple *threshold_tuple = NULL;
+  Tuple *reserve_tuple = NULL;
+  Tuple *priority_tuple = NULL;
+  Tuple *policy_tuple = NULL;
+  Tuple *sync_tuple = NULL;
+  size_t bytes_copied = 0;
+
+  // One pass over the dictionary instead of a dict_find walk per key
+  for( Tuple *tuple = dict_read_first(iter); tuple != NULL; tuple = dict_read_next(iter) )
   {
-    strcpy(msg1.scroll_text,scroll_text[1]);
-    msg1.header_time = header_time[1];
-    strcpy(msg2.from_text,from_text[1]);
-    strcpy(msg2.subject_text,subject_text[1]);
-    strcpy(msg1.uuid_text,uuid_text[1]);
-    msg1.account_id = account_id[1];
-    msg1.deleted = deleted[1];
-    persist_write_data(0x20, &msg1, sizeof(message_1_t));
-    persist_write_data(0x21, &msg2, sizeof(message_2_t));
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Saved message with subject: %s",msg2.subject_text);
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Saved message text: %s",msg1.scroll_text);
+    switch( tuple->key )
+    {
+      case KEY_MSG_UUID: uuid_tuple = tuple; break;
+      case KEY_UTC_OFFSET: offset_tuple = tuple; break;
+      case KEY_MSG_TIME: time_tuple = tuple; break;
+      case KEY_MSG_FROM: from_tuple = tuple; break;
+      case KEY_MSG_SUBJECT: subject_tuple = tuple; break;
+      case KEY_MSG_TEXT: text_tuple = tuple; break;
+      case KEY_VIBE_PATTERN: vibe_pattern_tuple = tuple; break;
+      case KEY_ACTION_SUPPORT: action_support_tuple = tuple; break;
+      case KEY_ACCOUNT_ID: account_id_tuple = tuple; break;
+      case KEY_MSG_ENCODING: encoding_tuple = tuple; break;
+      case KEY_DEBUG_CMD: debug_tuple = tuple; break;
+      case KEY_LOW_POWER_THRESHOLD: threshold_tuple = tuple; break;
+      case KEY_ACCOUNT_RESERVE: reserve_tuple = tuple; break;
+      case KEY_MSG_PRIORITY: priority_tuple = tuple; break;
+      case KEY_EVICTION_POLICY: policy_tuple = tuple; break;
+      case KEY_SYNC_CMD: sync_tuple = tuple; break;
+      default: break;
+    }
   }
-  
-  if( index == -1 || index == 2 )
+    
+  // Nothing from the phone is trusted to be well formed: strings may be
+  // unterminated or the wrong type, integers come in any width and optional
+  // fields may be missing. An empty UUID is treated as no UUID.
+  char uuid[MAX_TEXT_LENGTH-10];
+  copy_tuple_text(uuid, sizeof(uuid), uuid_tuple);
+  if( uuid[0] == '\0' )
+    uuid_tuple = NULL;
+
+  // Act on the found fields received
+  if( offset_tuple && tuple_int(offset_tuple, 0) != app_metadata.utc_offset )
   {
-    strcpy(msg1.scroll_text,scroll_text[2]);
-    msg1.header_time = header_time[2];
-    strcpy(msg2.from_text,from_text[2]);
-    strcpy(msg2.subject_text,subject_text[2]);
-    strcpy(msg1.uuid_text,uuid_text[2]);
-    msg1.account_id = account_id[2];
-    msg1.deleted = deleted[2];
-    persist_write_data(0x30, &msg1, sizeof(message_1_t));
-    persist_write_data(0x31, &msg2, sizeof(message_2_t));
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Saved message with subject: %s",msg2.subject_text);
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Saved message text: %s",msg1.scroll_text);
+    // After travel or a DST change only the ages move
+    app_metadata.utc_offset = tuple_int(offset_tuple, 0);
+    save_utc_offset();
+    update_ages();
   }
-  
-  if( index == -1 || index == 3 )
+  if( threshold_tuple && tuple_int(threshold_tuple, -1) >= 0 && tuple_int(threshold_tuple, -1) <= 100 )
   {
-    strcpy(msg1.scroll_text,scroll_text[3]);
-    msg1.header_time = header_time[3];
-    strcpy(msg2.from_text,from_text[3]);
-    strcpy(msg2.subject_text,subject_text[3]);
-    strcpy(msg1.uuid_text,uuid_text[3]);
-    msg1.account_id = account_id[3];
-    msg1.deleted = deleted[3];
-    persist_write_data(0x40, &msg1, sizeof(message_1_t));
-    persist_write_data(0x41, &msg2, sizeof(message_2_t));
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Saved message with subject: %s",msg2.subject_text);
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Saved message text: %s",msg1.scroll_text);
+    app_metadata.low_power_threshold = tuple_int(threshold_tuple, 0);
+    power_set_threshold(app_metadata.low_power_threshold);
   }
-  
-  if( index == -1 || index == 4 )
+  if( reserve_tuple && tuple_int(reserve_tuple, -1) >= 0 && tuple_int(reserve_tuple, -1) < MAX_MESSAGES )
   {
-    strcpy(msg1.scroll_text,scroll_text[4]);
-    msg1.header_time = header_time[4];
-    strcpy(msg2.from_text,from_text[4]);
-    strcpy(msg2.subject_text,subject_text[4]);
-    strcpy(msg1.uuid_text,uuid_text[4]);
-    msg1.account_id = account_id[4];
-    msg1.deleted = deleted[4];
-    persist_write_data(0x50, &msg1, sizeof(message_1_t));
-    persist_write_data(0x51, &msg2, sizeof(message_2_t));
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Saved message with subject: %s",msg2.subject_text);
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Saved message text: %s",msg1.scroll_text);
+    app_metadata.account_reserve = tuple_int(reserve_tuple, 0);
   }
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Persisting complete.");
-}
-
-//
-// Handle AppMessage
-//
-
-void out_sent_handler(DictionaryIterator *sent, void *context) {
-   // outgoing message was delivered
-   APP_LOG(APP_LOG_LEVEL_DEBUG, "Outgoing message was delivered successfully.");
-   retries = 0;
-   actions_enabled = 1;
-   show_actionbar(action_bar);
-  
-   if( msg_cmd == VAL_CMD_DELETE )
-   {
-     deleted[msg_send_index] = 1;
-     persist_messages(msg_send_index);
-     refresh_screen();
-   }
-}
-
-
-void out_failed_handler(DictionaryIterator *failed, AppMessageResult reason, void *context) {
-  // outgoing message failed  
-   APP_LOG(APP_LOG_LEVEL_DEBUG, "Failed to send outgoing message: %d",reason);
-   text_layer_set_text(errorConfirmationTextLayer, "An unknown error occurred.");
-  
-   switch(reason)
-     {
-     case APP_MSG_ALREADY_RELEASED:
-     APP_LOG(APP_LOG_LEVEL_DEBUG, "Already Released");
-     break;
-     
-     case APP_MSG_BUFFER_OVERFLOW:
-     APP_LOG(APP_LOG_LEVEL_DEBUG, "Buffer Overflow");
-     break;
-     
-     case APP_MSG_BUSY:
-     APP_LOG(APP_LOG_LEVEL_DEBUG, "Busy");
-     if( retries < 3 )
-     {
-       retries++;
-       
-       DictionaryIterator *iter;
-       app_message_outbox_begin(&iter);
-       Tuplet value = TupletInteger(KEY_CMD, msg_cmd);
-       dict_write_tuplet(iter, &value);
-       Tuplet acct = TupletInteger(KEY_ACCOUNT_ID, msg_account);
-       dict_write_tuplet(iter, &acct);
-       Tuplet msg = TupletCString(KEY_MSG_UUID, &msg_uuid[0]);
-       dict_write_tuplet(iter,&msg);
-       app_message_outbox_send();
-       return;
-     }
-     else
-     {
-       text_layer_set_text(errorConfirmationTextLayer, "Too busy to send command.");       
-     }
-     break;
-     
-     case APP_MSG_INVALID_ARGS:
-     APP_LOG(APP_LOG_LEVEL_DEBUG, "Invalid Args");
-     break;
-     
-     case APP_MSG_NOT_CONNECTED:
-     APP_LOG(APP_LOG_LEVEL_DEBUG, "Not Connected");
-     text_layer_set_text(errorConfirmationTextLayer, "Not connected to watch.");
-     break;
-     
-    case APP_MSG_OUT_OF_MEMORY:
-     APP_LOG(APP_LOG_LEVEL_DEBUG, "Out of Memory");
-     text_layer_set_text(errorConfirmationTextLayer, "Out of memory.");
-     break;
-     
-     case APP_MSG_SEND_REJECTED:
-     APP_LOG(APP_LOG_LEVEL_DEBUG, "Send Rejected");
-     if( retries < 3 )
-     {
-       retries++;
-       
-       DictionaryIterator *iter;
-       app_message_outbox_begin(&iter);
-       Tuplet value = TupletInteger(KEY_CMD, msg_cmd);
-       dict_write_tuplet(iter, &value);
-       Tuplet acct = TupletInteger(KEY_ACCOUNT_ID, msg_account);
-       dict_write_tuplet(iter, &acct);
-       Tuplet msg = TupletCString(KEY_MSG_UUID, &msg_uuid[0]);
-       dict_write_tuplet(iter,&msg);
-       app_message_outbox_send();
-       return;
-     }
-     else
-     {
-       text_layer_set_text(errorConfirmationTextLayer, "Message rejected.");
-     }
-
-     break;
-     
-     case APP_MSG_SEND_TIMEOUT:
-     APP_LOG(APP_LOG_LEVEL_DEBUG, "Send Timeout");
-     if( retries < 3 )
-     {
-       retries++;
-       
-       DictionaryIterator *iter;
-       app_message_outbox_begin(&iter);
-       Tuplet value = TupletInteger(KEY_CMD, msg_cmd);
-       dict_write_tuplet(iter, &value);
-       Tuplet acct = TupletInteger(KEY_ACCOUNT_ID, msg_account);
-       dict_write_tuplet(iter, &acct);
-       Tuplet msg = TupletCString(KEY_MSG_UUID, &msg_uuid[0]);
-       dict_write_tuplet(iter,&msg);
-       app_message_outbox_send();
-       return;
-     }
-     else
-     {
-       text_layer_set_text(errorConfirmationTextLayer, "Message timed out.");  
-     }
-
-     break;
-     
-     default:
-     break;
-   }
-  retries = 0;
-  actions_enabled = 1;
-  show_actionbar(action_bar);
-  
-  mode = MODE_ERROR;
-  layer_set_hidden(text_layer_get_layer(errorLayer), false);
-  error_hide_timer = app_timer_register(3*1000, handle_error_hide_timer, NULL);
-}
-
-void in_received_handler(DictionaryIterator *iter, void *context) {
-  
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Received new message from phone.");
-
-  // incoming message received
-  reschedule_kill_timer();
-  
-  Tuple *uuid_tuple = dict_find(iter, KEY_MSG_UUID);
-  Tuple *offset_tuple = dict_find(iter, KEY_UTC_OFFSET);
-  Tuple *time_tuple = dict_find(iter, KEY_MSG_TIME);
-  Tuple *from_tuple = dict_find(iter, KEY_MSG_FROM);
-  Tuple *subject_tuple = dict_find(iter, KEY_MSG_SUBJECT);
-  Tuple *text_tuple = dict_find(iter,KEY_MSG_TEXT);
-  Tuple *vibe_pattern_tuple = dict_find(iter,KEY_VIBE_PATTERN);
-  Tuple *action_support_tuple = dict_find(iter,KEY_ACTION_SUPPORT);
-  Tuple *account_id_tuple = dict_find(iter,KEY_ACCOUNT_ID);
-    
-  // Act on the found fields received
-  if( offset_tuple )
+  if( policy_tuple && tuple_int(policy_tuple, -1) >= 0 && tuple_int(policy_tuple, -1) < NUM_EVICTION_POLICIES )
   {
-    app_metadata.utc_offset = offset_tuple->value->int32;
+    app_metadata.eviction_policy = tuple_int(policy_tuple, 0);
   }
-  if (uuid_tuple && subject_tuple) {
+  if( sync_tuple ) {
+    LOG_DEBUG(LOG_CAT_MSG, "Found sync command: %d", (int)tuple_int(sync_tuple, -1));
+    apply_sync(tuple_int(sync_tuple, -1), uuid_tuple ? uuid : NULL, account_id_tuple);
+  }
+  else if (uuid_tuple && subject_tuple) {
     
     for( int8_t i = 0; i < MAX_MESSAGES; i++ )
     {
-       if( strcmp(uuid_tuple->value->cstring,uuid_text[i]) == 0 )
+       if( strcmp(uuid,uuid_text[i]) == 0 )
        {
-         APP_LOG(APP_LOG_LEVEL_DEBUG, "Received duplicate for email UUID: %s", uuid_tuple->value->cstring);
+         LOG_DEBUG(LOG_CAT_MSG, "Received duplicate for email UUID: %s", uuid);
+         metrics_count(METRIC_DEDUP_HITS, 1);
          return;
        }
     }
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Found initial data for email UUID: %s", uuid_tuple->value->cstring);
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Message From(%s) with Subject(%s)", from_tuple->value->cstring, subject_tuple->value->cstring);
+    LOG_DEBUG(LOG_CAT_MSG, "Found initial data for email UUID: %s", uuid);
+
+    uint32_t account = tuple_int(account_id_tuple, 0);
+    int8_t toWrite = store_victim(account);
+    if( toWrite < 0 )
+    {
+      LOG_ERROR(LOG_CAT_STORE, "No slot to store the message in");
+      return;
+    }
+    LOG_DEBUG(LOG_CAT_MSG, "Copying message data into buffers at index %d...",toWrite);
 
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Copying message data into buffers at index %d...",app_metadata.next_write_index);
+    if( (filled_slots & ~deleted_slots) & SLOT_BIT(toWrite) )
+      accounts_count(account_id[toWrite], ACCOUNT_EVICTED);
+    accounts_count(account, ACCOUNT_RECEIVED);
     
-    header_time[app_metadata.next_write_index] = time_tuple->value->int32;
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Timestamp on message is %d.",(int)header_time[app_metadata.next_write_index]);
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Now is %d.",(int)time(NULL));
-    strcpy(uuid_text[app_metadata.next_write_index],uuid_tuple->value->cstring);
-    strcpy(from_text[app_metadata.next_write_index],from_tuple->value->cstring);
-    strcpy(subject_text[app_metadata.next_write_index],subject_tuple->value->cstring);
-    strcpy(scroll_text[app_metadata.next_write_index],"...");
-    account_id[app_metadata.next_write_index] = account_id_tuple->value->uint32;
-    deleted[app_metadata.next_write_index] = 0;
+    header_time[toWrite] = tuple_int(time_tuple, utc_now());
+    LOG_DEBUG(LOG_CAT_MSG, "Timestamp on message is %d.",(int)header_time[toWrite]);
+    LOG_DEBUG(LOG_CAT_MSG, "Now is %d.",(int)time(NULL));
+    strcpy(uuid_text[toWrite], uuid);
+    bytes_copied += strlen(uuid);
+    bytes_copied += copy_tuple_text(from_text[toWrite], MAX_TEXT_LENGTH, from_tuple);
+    bytes_copied += copy_tuple_text(subject_text[toWrite], MAX_TEXT_LENGTH, subject_tuple);
+    strcpy(scroll_text[toWrite],"...");
+    body_height[toWrite] = 0;
+    body_pending = 1;
+    account_id[toWrite] = account;
+    set_slot_bit(&deleted_slots, toWrite, false);
+    set_slot_bit(&read_slots, toWrite, false);
+    set_slot_bit(&priority_slots, toWrite, tuple_int(priority_tuple, 0) != 0);
     
-    persist_messages(app_metadata.next_write_index);
- 
-    app_metadata.next_write_index++;
-    if( app_metadata.next_write_index >  MAX_MESSAGES-1 )
-      app_metadata.next_write_index = 0;
-    app_metadata.num_messages_filled++;
-    if( app_metadata.num_messages_filled > MAX_MESSAGES )
-      app_metadata.num_messages_filled = MAX_MESSAGES;
+    persist_messages(toWrite);
+    store_insert(toWrite);
+    render_pending_slot = toWrite;
+    render_start = inbound_start;
 
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Updating UI text layers...");
+    LOG_DEBUG(LOG_CAT_UI, "Updating UI text layers...");
     refresh_screen();  
+
+    // The new message lands at index 0 if it is in view. Stay on it if it
+    // was the newest in view, otherwise keep the message being read on
+    // screen.
+    if( slot_at(0) == toWrite )
+      set_cursor(cursor > 0 ? cursor+1 : 0, false);
+    else
+      set_cursor(cursor, false);
     
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Total messages stored is now %d", app_metadata.num_messages_filled);
+    LOG_DEBUG(LOG_CAT_MSG, "Total messages stored is now %d", app_metadata.num_messages_filled);
   }
   else if( uuid_tuple && text_tuple) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Found email body data for email UUID: %s", uuid_tuple->value->cstring);    
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Found email body data: %s", text_tuple->value->cstring);
+    LOG_DEBUG(LOG_CAT_MSG, "Found email body data for email UUID: %s", uuid);    
 
-    int8_t toWrite = app_metadata.next_write_index-1;
-    if( toWrite < 0 )
-      toWrite = MAX_MESSAGES-1;
+    int8_t toWrite = app_metadata.order[0];
 
-    if( strcmp(uuid_tuple->value->cstring,uuid_text[toWrite]) == 0 )
+    if( app_metadata.num_messages_filled > 0 && strcmp(uuid,uuid_text[toWrite]) == 0 )
     {
-      TextLayer* bodyText = text_layer[0];
-      
-      APP_LOG(APP_LOG_LEVEL_DEBUG, "Copying email body into buffer...");
+      uint8_t encoding = tuple_int(encoding_tuple, 0);
+
+      // Appended chunks continue where the body left off, anything else
+      // replaces the "..." placeholder
+      size_t offset = 0;
+      if( encoding & MSG_ENCODING_APPEND )
+        offset = strlen(scroll_text[toWrite]);
+
+      LOG_DEBUG(LOG_CAT_MSG, "Copying email body into buffer at %d...", (int)offset);
 
-      strcpy(scroll_text[toWrite],text_tuple->value->cstring);
+      if( (encoding & MSG_ENCODING_CODEC) && text_tuple->type == TUPLE_BYTE_ARRAY )
+      {
+        // Decode straight into the slot
+        bytes_copied += text_codec_decode(text_tuple->value->data, text_tuple->length, &scroll_text[toWrite][offset], MAX_TEXT_LENGTH-offset);
+      }
+      else
+      {
+        bytes_copied += copy_tuple_text(&scroll_text[toWrite][offset], MAX_TEXT_LENGTH-offset, text_tuple);
+      }
+      body_pending = (encoding & MSG_ENCODING_MORE) != 0;
+      LOG_VERBOSE(LOG_CAT_MSG, "Found email body data: %s", scroll_text[toWrite]);
       persist_messages(toWrite);
       
-      APP_LOG(APP_LOG_LEVEL_DEBUG, "Updated UI text layers...");
-      text_layer_set_text(bodyText, scroll_text[toWrite]);
+      LOG_DEBUG(LOG_CAT_UI, "Updated UI text layers...");
+      body_height[toWrite] = 0;
+      redraw_slot(toWrite);
+
+      // Only this card changed height, the ones above it stay put
+      int8_t card = card_of(toWrite);
+      if( card >= 0 )
+        layout_cards(card);
     }
   }
   else if( action_support_tuple ) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Found action enable message: %d", action_support_tuple->value->int8);
-    app_metadata.actions_enabled = action_support_tuple->value->int8;
+    LOG_DEBUG(LOG_CAT_MSG, "Found action enable message: %d", (int)tuple_int(action_support_tuple, 0));
+    app_metadata.actions_enabled = tuple_int(action_support_tuple, 0);
   }
-  
-  if( vibe_pattern_tuple ) {
-    switch(vibe_pattern_tuple->value->int8)
+  else if( debug_tuple ) {
+    switch(tuple_int(debug_tuple, -1))
     {
-      case VIBE_PATTERN_SHORT:
-      vibes_short_pulse();
+      case VAL_DEBUG_DUMP_METRICS:
+      metrics_log();
+      accounts_log();
+      send_service_message(VAL_CMD_METRICS);
       break;
-      
-      case VIBE_PATTERN_LONG:
-      vibes_long_pulse();
+
+      case VAL_DEBUG_RESET_METRICS:
+      metrics_reset();
+      accounts_reset();
       break;
-      
-      case VIBE_PATTERN_DOUBLE:
-      vibes_double_pulse();
+
+#ifdef DEBUG_COMMANDS
+      case VAL_DEBUG_INJECT_BUSY:
+      case VAL_DEBUG_INJECT_REJECT:
+      case VAL_DEBUG_INJECT_TIMEOUT:
+      if( injected_failures < MAX_INJECTED_FAILURES )
+      {
+        AppMessageResult failure = APP_MSG_SEND_TIMEOUT;
+        if( tuple_int(debug_tuple, -1) == VAL_DEBUG_INJECT_BUSY )
+          failure = APP_MSG_BUSY;
+        else if( tuple_int(debug_tuple, -1) == VAL_DEBUG_INJECT_REJECT )
+          failure = APP_MSG_SEND_REJECTED;
+        injected_failure[injected_failures++] = failure;
+      }
       break;
-      
+#endif
+
       default:
       break;
     }
   }
-    
+  
+  if( vibe_pattern_tuple ) {
+    vibe_request(tuple_int(vibe_pattern_tuple, 0));
+  }
+
+  LOG_DEBUG(LOG_CAT_MSG, "Copied %d bytes from the message.", (int)bytes_copied);
+  metrics_count(METRIC_INBOUND_BYTES_COPIED, bytes_copied);
+}
+
+void in_received_handler(DictionaryIterator *iter, void *context) {
+  
+  LOG_DEBUG(LOG_CAT_MSG, "Received new message from phone.");
+
+  // incoming message received
+  reschedule_kill_timer(false);
+  metrics_count(METRIC_INBOUND_MESSAGES, 1);
+
+  // A one-off launch cost, kept out of the per-message budget below
+  finish_deferred_load();
+
+  uint32_t start = metrics_now();
+  inbound_start = start;
+  uint32_t persist_bytes = metrics_get(METRIC_PERSIST_BYTES);
+  uint32_t layer_updates = metrics_get(METRIC_LAYER_UPDATES);
+
+  process_inbound(iter);
+
+  metrics_record_time(TIMER_INBOUND, start);
+  metrics_record_max(METRIC_HEAP_USED, heap_bytes_used());
+
+  // Flag messages that cost more than the receive path should, so a replay
+  // from the phone can check for regressions with a reset and a dump
+  uint32_t elapsed = metrics_now() - start;
+  persist_bytes = metrics_get(METRIC_PERSIST_BYTES) - persist_bytes;
+  layer_updates = metrics_get(METRIC_LAYER_UPDATES) - layer_updates;
+  if( elapsed > INBOUND_BUDGET_MS || persist_bytes > INBOUND_BUDGET_PERSIST_BYTES || layer_updates > INBOUND_BUDGET_LAYER_UPDATES )
+  {
+    LOG_WARNING(LOG_CAT_MSG, "Inbound message over budget: %u ms, %u persist bytes, %u layer updates",
+                (unsigned)elapsed, (unsigned)persist_bytes, (unsigned)layer_updates);
+    metrics_count(METRIC_INBOUND_OVER_BUDGET, 1);
+  }
 }
 
 void in_dropped_handler(AppMessageResult reason, void *context) {
@@ -598,406 +1586,424 @@ void in_dropped_handler(AppMessageResult reason, void *context) {
 //
 // Button Action Events
 //
-void back_single_click_handler(ClickRecognizerRef recognizer, void *context) {
+
+#define NO_COMMAND -1
+
+#define REPEAT_INTERVAL_MS 150
+#define REPEAT_ACCELERATE_CLICKS 4
+#define REPEAT_JUMP_CLICKS 12
+
+// What a button does in each mode: scroll by a message, send a command for
+// the message in view, then move to next_mode
+typedef struct mode_transition_t
+{
+  int8_t scroll;
+  int8_t command;
+  uint8_t next_mode;
+} mode_transition_t;
+
+static const mode_transition_t mode_transitions[NUM_MODES][NUM_BUTTONS] = {
+  [MODE_SCROLL] = {
+    [BUTTON_ID_BACK] = { 0, NO_COMMAND, MODE_ACTION },
+    [BUTTON_ID_UP] = { -1, NO_COMMAND, MODE_SCROLL },
+    [BUTTON_ID_SELECT] = { 0, NO_COMMAND, MODE_DELETE_CONFIRM },
+    [BUTTON_ID_DOWN] = { 1, NO_COMMAND, MODE_SCROLL },
+  },
+  [MODE_ACTION] = {
+    [BUTTON_ID_BACK] = { 0, NO_COMMAND, MODE_SCROLL },
+    [BUTTON_ID_UP] = { 0, VAL_CMD_REPLY1, MODE_ACTION },
+    [BUTTON_ID_SELECT] = { 0, VAL_CMD_OPEN, MODE_ACTION },
+    [BUTTON_ID_DOWN] = { 0, VAL_CMD_REPLY2, MODE_ACTION },
+  },
+  [MODE_DELETE_CONFIRM] = {
+    [BUTTON_ID_BACK] = { 0, NO_COMMAND, MODE_SCROLL },
+    [BUTTON_ID_UP] = { 0, NO_COMMAND, MODE_SCROLL },
+    [BUTTON_ID_SELECT] = { 0, VAL_CMD_DELETE, MODE_SCROLL },
+    [BUTTON_ID_DOWN] = { 0, NO_COMMAND, MODE_SCROLL },
+  },
+  [MODE_ERROR] = {
+    [BUTTON_ID_BACK] = { 0, NO_COMMAND, MODE_SCROLL },
+    [BUTTON_ID_UP] = { 0, NO_COMMAND, MODE_SCROLL },
+    [BUTTON_ID_SELECT] = { 0, NO_COMMAND, MODE_SCROLL },
+    [BUTTON_ID_DOWN] = { 0, NO_COMMAND, MODE_SCROLL },
+  },
+  [MODE_LIST] = {
+    [BUTTON_ID_BACK] = { 0, NO_COMMAND, MODE_SCROLL },
+    [BUTTON_ID_UP] = { -1, NO_COMMAND, MODE_LIST },
+    [BUTTON_ID_SELECT] = { 0, NO_COMMAND, MODE_SCROLL },
+    [BUTTON_ID_DOWN] = { 1, NO_COMMAND, MODE_LIST },
+  },
+};
+
+// Long cards are read a page at a time before moving to the next message.
+// The list moves a row at a time, its card following out of sight.
+static void scroll_by(int8_t step)
+{
+  int16_t page = page_height-CARD_PAGE_OVERLAP;
+  int16_t card_bottom = card_offset[cursor+1];
+
+  if( mode == MODE_LIST )
+    set_cursor(cursor+step, false);
+  else if( step > 0 && scroll_y+page_height < card_bottom )
+    scroll_to(scroll_y+page < card_bottom-page_height ? scroll_y+page : card_bottom-page_height, true);
+  else if( step < 0 && scroll_y > card_offset[cursor] )
+    scroll_to(scroll_y-page > card_offset[cursor] ? scroll_y-page : card_offset[cursor], true);
+  else
+    set_cursor(cursor+step, true);
+}
+
+static void handle_button(ButtonId button)
+{
+  reschedule_kill_timer(true);
+  if( view_count > 0 )
+    mark_read(current_slot());
   
   if( actions_enabled == 0 )
     return;
+
+  metrics_count(METRIC_BUTTON_PRESSES, 1);
+
+  const mode_transition_t *transition = &mode_transitions[mode][button];
+  if( transition->scroll != 0 )
+    scroll_by(transition->scroll);
+  // An empty filtered view leaves nothing to act on
+  if( transition->command != NO_COMMAND && view_count > 0 )
+    send_command(transition->command, current_slot());
+  set_mode(transition->next_mode);
+}
+
+void back_single_click_handler(ClickRecognizerRef recognizer, void *context) {
   
-  layer_set_hidden(text_layer_get_layer(deleteConfirmLayer), true);
-  layer_set_hidden(text_layer_get_layer(errorLayer), true);
+  if( actions_enabled == 0 )
+    return;
   
-  if( mode == MODE_SCROLL && app_metadata.actions_enabled == 1 )
-  {
-    reschedule_kill_timer();
-    mode = MODE_ACTION;
-    
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_UP, reply1);
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_DOWN, reply2);
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_SELECT, open);
-  }
-  else if( app_metadata.actions_enabled == 1 )
-  {
-    reschedule_kill_timer();
-    mode = MODE_SCROLL;
-    
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_UP, upArrow);  
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_DOWN, downArrow);
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_SELECT, trash);
-  }
-  else
+  // Without phone side actions there is nothing to switch to, so back exits
+  if( app_metadata.actions_enabled != 1 && mode != MODE_LIST )
   {
     if( kill_timer != NULL )
       app_timer_cancel(kill_timer);
     kill_timer = NULL;
     window_stack_pop_all(true); 
+    return;
   }
+
+  handle_button(BUTTON_ID_BACK);
 }
 
-void down_single_click_handler(ClickRecognizerRef recognizer, void *context) {
-  Window *window = (Window *)context; // This context defaults to the window, but may be changed with \ref window_set_click_context.
-  reschedule_kill_timer();
-  
-  if( actions_enabled == 0 )
+// Holding up or down keeps scrolling, a page per repeat at first and then
+// faster; held long enough it jumps to the newest or oldest message. Repeats
+// move without animation so the view keeps up with the button, and the card
+// at the top of the screen becomes the one in view.
+static void handle_scroll_repeat(ClickRecognizerRef recognizer, int8_t direction)
+{
+  reschedule_kill_timer(true);
+
+  if( actions_enabled == 0 || (mode != MODE_SCROLL && mode != MODE_LIST) )
     return;
-  
-  if( mode == MODE_SCROLL )
-  {
-    GRect scrollFrame = layer_get_frame(scroll_layer_get_layer(scroll_layer));
-    GPoint current = scroll_layer_get_content_offset(scroll_layer);
-    int16_t yPos = (current.y / scrollFrame.size.h)*-1;
 
-    yPos++;
-  
-    if( yPos > app_metadata.num_messages_filled-1 )
-      yPos = app_metadata.num_messages_filled-1;
-    if( yPos < 0 )
-      yPos = 0;
-  
-    scroll_layer_set_content_offset(scroll_layer, GPoint(0,yPos*scrollFrame.size.h*-1), true);
-  }
-  else if( mode == MODE_ACTION )
-  {
-     // POST REPLY2 MESSAGE TO PHONE
-     GRect scrollFrame = layer_get_frame(scroll_layer_get_layer(scroll_layer));
-     GPoint current = scroll_layer_get_content_offset(scroll_layer);
-     int16_t yPos = (current.y / scrollFrame.size.h)*-1;
-    
-     int8_t toSend = app_metadata.next_write_index-1;
-     if( toSend < 0 )
-        toSend = MAX_MESSAGES-1;
-
-     while( yPos > 0 )
-     {
-       yPos--;
-       toSend--;
-       if( toSend < 0 )
-         toSend = MAX_MESSAGES-1;
-     }
-
-     actions_enabled = 0;
-     hide_actionbar(action_bar);
-     msg_cmd = VAL_CMD_DELETE;
-     msg_account = (uint32_t)account_id[toSend];
-     strcpy(msg_uuid,uuid_text[toSend]);
-     msg_send_index = toSend;
-
-     DictionaryIterator *iter;
-     app_message_outbox_begin(&iter);
-     Tuplet value = TupletInteger(KEY_CMD, VAL_CMD_REPLY2);
-     dict_write_tuplet(iter, &value);
-     Tuplet acct = TupletInteger(KEY_ACCOUNT_ID, (uint32_t)account_id[toSend]);
-     dict_write_tuplet(iter, &acct);
-     Tuplet msg = TupletCString(KEY_MSG_UUID, uuid_text[toSend]);
-     dict_write_tuplet(iter,&msg);
-     app_message_outbox_send();
-  }
+  metrics_count(METRIC_BUTTON_PRESSES, 1);
+
+  uint8_t clicks = click_number_of_clicks_counted(recognizer);
+  if( mode == MODE_LIST )
+    scroll_by(direction);
+  else if( clicks >= REPEAT_JUMP_CLICKS )
+    set_cursor(direction < 0 ? 0 : view_count-1, false);
   else
   {
-    layer_set_hidden(text_layer_get_layer(deleteConfirmLayer), true);
-    layer_set_hidden(text_layer_get_layer(errorLayer), true);
-    mode = MODE_SCROLL;
-    
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_UP, upArrow);  
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_DOWN, downArrow);
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_SELECT, trash);
+    scroll_to(scroll_y + direction*page_height*(1 + clicks/REPEAT_ACCELERATE_CLICKS), false);
+    cursor = card_at(scroll_y);
+    mark_read(current_slot());
   }
 }
 
-void up_single_click_handler(ClickRecognizerRef recognizer, void *context) {
-  Window *window = (Window *)context; // This context defaults to the window, but may be changed with \ref window_set_click_context.
-  reschedule_kill_timer();
-  
-  if( actions_enabled == 0 )
-    return;
-  
-  if( mode == MODE_SCROLL )
-  {
-    GRect scrollFrame = layer_get_frame(scroll_layer_get_layer(scroll_layer));
-    GPoint current = scroll_layer_get_content_offset(scroll_layer);
-    int16_t yPos = (current.y / scrollFrame.size.h)*-1;
+void down_single_click_handler(ClickRecognizerRef recognizer, void *context) {
+  if( click_recognizer_is_repeating(recognizer) )
+    handle_scroll_repeat(recognizer, 1);
+  else
+    handle_button(BUTTON_ID_DOWN);
+}
 
-    yPos--;
-  
-    if( yPos < 0 )
-      yPos = 0;
-  
-    scroll_layer_set_content_offset(scroll_layer, GPoint(0,yPos*scrollFrame.size.h*-1), true);
-  }
-  else if( mode == MODE_ACTION )
-  {
-     // POST REPLY1 ACTION TO PHONE
-     GRect scrollFrame = layer_get_frame(scroll_layer_get_layer(scroll_layer));
-     GPoint current = scroll_layer_get_content_offset(scroll_layer);
-     int16_t yPos = (current.y / scrollFrame.size.h)*-1;
-    
-     int8_t toSend = app_metadata.next_write_index-1;
-     if( toSend < 0 )
-        toSend = MAX_MESSAGES-1;
-
-     while( yPos > 0 )
-     {
-       yPos--;
-       toSend--;
-       if( toSend < 0 )
-         toSend = MAX_MESSAGES-1;
-     }
-
-     actions_enabled = 0;
-     hide_actionbar(action_bar);
-     msg_cmd = VAL_CMD_DELETE;
-     msg_account = (uint32_t)account_id[toSend];
-     strcpy(msg_uuid,uuid_text[toSend]);
-     msg_send_index = toSend;
-
-     DictionaryIterator *iter;
-     app_message_outbox_begin(&iter);
-     Tuplet value = TupletInteger(KEY_CMD, VAL_CMD_REPLY1);
-     dict_write_tuplet(iter, &value);
-     Tuplet acct = TupletInteger(KEY_ACCOUNT_ID, (uint32_t)account_id[toSend]);
-     dict_write_tuplet(iter, &acct);
-     Tuplet msg = TupletCString(KEY_MSG_UUID, uuid_text[toSend]);
-     dict_write_tuplet(iter,&msg);
-     app_message_outbox_send();
-  }
+void up_single_click_handler(ClickRecognizerRef recognizer, void *context) {
+  if( click_recognizer_is_repeating(recognizer) )
+    handle_scroll_repeat(recognizer, -1);
   else
-  {
-    layer_set_hidden(text_layer_get_layer(deleteConfirmLayer), true);
-    layer_set_hidden(text_layer_get_layer(errorLayer), true);
-    mode = MODE_SCROLL;
-    
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_UP, upArrow);  
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_DOWN, downArrow);
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_SELECT, trash);
-  }
+    handle_button(BUTTON_ID_UP);
 }
 
 void middle_single_click_handler(ClickRecognizerRef recognizer, void *context) {
-  reschedule_kill_timer();
-  
+  handle_button(BUTTON_ID_SELECT);
+}
+
+// Holding select switches from the cards to the summary list. In the list it
+// shows only the highlighted message's account, or everything again if the
+// list was already filtered, which also works once the filtered account has
+// run out of messages. Picking a row drills back into its card.
+void middle_long_click_handler(ClickRecognizerRef recognizer, void *context) {
+  reschedule_kill_timer(true);
+
   if( actions_enabled == 0 )
     return;
-  
-  GRect scrollFrame = layer_get_frame(scroll_layer_get_layer(scroll_layer));
-  GPoint current = scroll_layer_get_content_offset(scroll_layer);
-  int16_t yPos = (current.y / scrollFrame.size.h)*-1;
-    
-  int8_t toSend = app_metadata.next_write_index-1;
-  if( toSend < 0 )
-    toSend = MAX_MESSAGES-1;
 
-  while( yPos > 0 )
-  {
-    yPos--;
-    toSend--;
-    if( toSend < 0 )
-      toSend = MAX_MESSAGES-1;
-  }
+  metrics_count(METRIC_BUTTON_PRESSES, 1);
 
   if( mode == MODE_SCROLL )
   {
-    mode = MODE_DELETE_CONFIRM;
-    layer_set_hidden(text_layer_get_layer(deleteConfirmLayer), false);
-  }
-  else if( mode == MODE_ACTION )
-  {
-    // POST OPEN TO PHONE
-     actions_enabled = 0;
-     hide_actionbar(action_bar);
-     msg_cmd = VAL_CMD_DELETE;
-     msg_account = (uint32_t)account_id[toSend];
-     strcpy(msg_uuid,uuid_text[toSend]);
-     msg_send_index = toSend;
-
-     DictionaryIterator *iter;
-     app_message_outbox_begin(&iter);
-     Tuplet value = TupletInteger(KEY_CMD, VAL_CMD_OPEN);
-     dict_write_tuplet(iter, &value);
-     Tuplet acct = TupletInteger(KEY_ACCOUNT_ID, (uint32_t)account_id[toSend]);
-     dict_write_tuplet(iter, &acct);
-     Tuplet msg = TupletCString(KEY_MSG_UUID, uuid_text[toSend]);
-     dict_write_tuplet(iter,&msg);
-     app_message_outbox_send();
-  }
-  else if( mode == MODE_ERROR )
-  {
-    layer_set_hidden(text_layer_get_layer(errorLayer), true);
-    mode = MODE_SCROLL;
-    
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_UP, upArrow);  
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_DOWN, downArrow);
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_SELECT, trash);
+    set_mode(MODE_LIST);
   }
-  else
+  else if( mode == MODE_LIST && (account_filtered || view_count > 0) )
   {
-     // POST DELETE TO PHONE  
-     actions_enabled = 0;
-     hide_actionbar(action_bar);
-     msg_cmd = VAL_CMD_DELETE;
-     msg_account = (uint32_t)account_id[toSend];
-     strcpy(msg_uuid,uuid_text[toSend]);
-     msg_send_index = toSend;
-
-     DictionaryIterator *iter;
-     app_message_outbox_begin(&iter);
-     Tuplet value = TupletInteger(KEY_CMD, VAL_CMD_DELETE);
-     dict_write_tuplet(iter, &value);
-     Tuplet acct = TupletInteger(KEY_ACCOUNT_ID, (uint32_t)account_id[toSend]);
-     dict_write_tuplet(iter, &acct);
-     Tuplet msg = TupletCString(KEY_MSG_UUID, uuid_text[toSend]);
-     dict_write_tuplet(iter,&msg);
-     app_message_outbox_send();
-    
-    // Go back to standard scroll mode
-    layer_set_hidden(text_layer_get_layer(deleteConfirmLayer), true);
-    mode = MODE_SCROLL;
-    
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_UP, upArrow);  
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_DOWN, downArrow);
-    action_bar_layer_set_icon(action_bar, BUTTON_ID_SELECT, trash);
+    if( !account_filtered )
+      account_filter = account_id[current_slot()];
+    account_filtered = !account_filtered;
+    refresh_screen();
+    set_cursor(0, false);
   }
 }
 
 void click_config_provider(void *context) {
  // single click / repeat-on-hold config:
-  window_single_click_subscribe(BUTTON_ID_DOWN, down_single_click_handler);
-  window_single_click_subscribe(BUTTON_ID_UP, up_single_click_handler);
+  window_single_repeating_click_subscribe(BUTTON_ID_DOWN, REPEAT_INTERVAL_MS, down_single_click_handler);
+  window_single_repeating_click_subscribe(BUTTON_ID_UP, REPEAT_INTERVAL_MS, up_single_click_handler);
   window_single_click_subscribe(BUTTON_ID_SELECT, middle_single_click_handler);
+  window_long_click_subscribe(BUTTON_ID_SELECT, 0, middle_long_click_handler, NULL);
   window_single_click_subscribe(BUTTON_ID_BACK, back_single_click_handler);
 }
 
 void handle_kill_timer(void *data)
 {
+    if( (actions_enabled == 0 || service_in_flight || body_pending) && kill_extensions < KILL_MAX_EXTENSIONS )
+    {
+      LOG_DEBUG(LOG_CAT_APP, "Work pending, staying open");
+      kill_extensions++;
+      metrics_count(METRIC_KILL_EXTENSIONS, 1);
+      kill_timer = app_timer_register(KILL_TIMEOUT_PENDING_MS, handle_kill_timer, NULL);
+      return;
+    }
+
     kill_timer = NULL;
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Closing app");
+    LOG_INFO(LOG_CAT_APP, "Closing app");
+    metrics_count(METRIC_IDLE_EXITS, 1);
     window_stack_pop_all(true);  
 }
 
-void load_messages()
+static void load_legacy_messages()
+{
+  LOG_DEBUG(LOG_CAT_STORE, "Migrating messages from version 1 storage...");
+
+  legacy_message_1_t msg1;
+  legacy_message_2_t msg2;
+
+  for( int8_t i = 0; i < MAX_MESSAGES; i++ )
+  {
+    if( !persist_exists(PERSIST_KEY_MESSAGE(i)) )
+      continue;
+
+    persist_read_data(PERSIST_KEY_MESSAGE(i), &msg1, sizeof(legacy_message_1_t));
+    persist_read_data(PERSIST_KEY_MESSAGE(i)+1, &msg2, sizeof(legacy_message_2_t));
+    msg1.uuid_text[sizeof(msg1.uuid_text)-1] = '\0';
+    msg1.scroll_text[sizeof(msg1.scroll_text)-1] = '\0';
+    msg2.from_text[sizeof(msg2.from_text)-1] = '\0';
+    msg2.subject_text[sizeof(msg2.subject_text)-1] = '\0';
+
+    header_time[i] = msg1.header_time;
+    strcpy(scroll_text[i],msg1.scroll_text);
+    strcpy(from_text[i],msg2.from_text);
+    strcpy(subject_text[i],msg2.subject_text);
+    strcpy(uuid_text[i],msg1.uuid_text);
+    account_id[i] = msg1.account_id;
+    set_slot_bit(&deleted_slots, i, msg1.deleted);
+
+    // Rewrite in the current format so this only happens once
+    persist_messages(i);
+  }
+}
+
+static bool store_is_current()
 {
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Loading current messages...sizeof(message_1_t)=%d, sizeof(message_2_t)=%d",sizeof(message_1_t),sizeof(message_2_t));
+  return persist_exists(PERSIST_KEY_VERSION) && persist_read_int(PERSIST_KEY_VERSION) >= PERSIST_VERSION;
+}
+
+static void load_message(int8_t i)
+{
+  if( slots_loaded & (1 << i) )
+    return;
+  slots_loaded |= 1 << i;
+
+  if( !persist_exists(PERSIST_KEY_MESSAGE(i)) )
+    return;
 
   message_1_t msg1;
   message_2_t msg2;
 
-  if( persist_exists(0x10) )
+  int size1 = persist_read_data(PERSIST_KEY_MESSAGE(i), &msg1, sizeof(message_1_t));
+  int size2 = persist_read_data(PERSIST_KEY_MESSAGE(i)+1, &msg2, sizeof(message_2_t));
+
+  // Text lengths have to fit in what was actually read; a record that
+  // fails that is kept as an empty message rather than read past its end
+  if( size1 < (int)offsetof(message_1_t, data) || msg1.uuid_length+msg1.text_length > size1-(int)offsetof(message_1_t, data) )
   {
-  persist_read_data(0x10, &msg1, sizeof(message_1_t));
-  persist_read_data(0x11, &msg2, sizeof(message_2_t));
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Found message from: %s",msg2.from_text);
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Subject: %s",msg2.subject_text);
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Text: %s",msg1.scroll_text);
-  header_time[0] = msg1.header_time;
-  strcpy(scroll_text[0],msg1.scroll_text);
-  strcpy(from_text[0],msg2.from_text);
-  strcpy(subject_text[0],msg2.subject_text);
-  strcpy(uuid_text[0],msg1.uuid_text);
-  account_id[0] = msg1.account_id;
-  deleted[0] = msg1.deleted;
+    LOG_ERROR(LOG_CAT_STORE, "Dropping corrupt record for slot %d", i);
+    memset(&msg1, 0, offsetof(message_1_t, data));
   }
-  
-  if( persist_exists(0x20) )
+  if( size2 < (int)offsetof(message_2_t, data) || msg2.from_length+msg2.subject_length > size2-(int)offsetof(message_2_t, data) )
   {
-  persist_read_data(0x20, &msg1, sizeof(message_1_t));
-  persist_read_data(0x21, &msg2, sizeof(message_2_t));
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Found message from: %s",msg2.from_text);
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Subject: %s",msg2.subject_text);
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Text: %s",msg1.scroll_text);
-
-  header_time[1] = msg1.header_time;
-  strcpy(scroll_text[1],msg1.scroll_text);
-  strcpy(from_text[1],msg2.from_text);
-  strcpy(subject_text[1],msg2.subject_text);
-  strcpy(uuid_text[1],msg1.uuid_text);
-  account_id[1] = msg1.account_id;
-  deleted[1] = msg1.deleted;
+    LOG_ERROR(LOG_CAT_STORE, "Dropping corrupt record for slot %d", i);
+    memset(&msg2, 0, offsetof(message_2_t, data));
   }
-  
-  if( persist_exists(0x30) )
+
+  header_time[i] = msg1.header_time;
+  account_id[i] = msg1.account_id;
+  set_slot_bit(&deleted_slots, i, msg1.deleted);
+  set_slot_bit(&read_slots, i, msg1.flags & PERSIST_READ);
+  set_slot_bit(&priority_slots, i, msg1.flags & PERSIST_PRIORITY);
+  body_height[i] = 0;
+  unpack_text(msg1.data, msg1.uuid_length, msg1.flags, PERSIST_UUID_ENCODED, uuid_text[i]);
+  unpack_text(&msg1.data[msg1.uuid_length], msg1.text_length, msg1.flags, PERSIST_TEXT_ENCODED, scroll_text[i]);
+  unpack_text(msg2.data, msg2.from_length, msg2.flags, PERSIST_FROM_ENCODED, from_text[i]);
+  unpack_text(&msg2.data[msg2.from_length], msg2.subject_length, msg2.flags, PERSIST_SUBJECT_ENCODED, subject_text[i]);
+  LOG_VERBOSE(LOG_CAT_STORE, "Found message from: %s",from_text[i]);
+  LOG_VERBOSE(LOG_CAT_STORE, "Subject: %s",subject_text[i]);
+  LOG_VERBOSE(LOG_CAT_STORE, "Text: %s",scroll_text[i]);
+}
+
+// Reads whatever part of the store is not in memory yet
+void load_messages()
+{
+  if( slots_loaded == ALL_SLOTS_LOADED )
+    return;
+
+  LOG_DEBUG(LOG_CAT_STORE, "Loading current messages...");
+
+  if( !store_is_current() )
   {
-  persist_read_data(0x30, &msg1, sizeof(message_1_t));
-  persist_read_data(0x31, &msg2, sizeof(message_2_t));
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Found message from: %s",msg2.from_text);
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Subject: %s",msg2.subject_text);
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Text: %s",msg1.scroll_text);
-
-  header_time[2] = msg1.header_time;
-  strcpy(scroll_text[2],msg1.scroll_text);
-  strcpy(from_text[2],msg2.from_text);
-  strcpy(subject_text[2],msg2.subject_text);
-  strcpy(uuid_text[2],msg1.uuid_text);
-  account_id[2] = msg1.account_id;
-  deleted[2] = msg1.deleted;
+    load_legacy_messages();
+    slots_loaded = ALL_SLOTS_LOADED;
+    persist_write_int(PERSIST_KEY_VERSION, PERSIST_VERSION);
+    return;
   }
-  
-  if( persist_exists(0x40) )
+
+  for( int8_t i = 0; i < MAX_MESSAGES; i++ )
+    load_message(i);
+
+  LOG_DEBUG(LOG_CAT_STORE, "Load complete.");
+}
+
+// Finishes loading the store after the first frame, then says hello with a
+// digest of it
+static void handle_deferred_load(void *data)
+{
+  finish_deferred_load();
+  send_service_message(VAL_CMD_HELLO);
+}
+
+// Low power mode drops the action bar animation; scrolling checks
+// power_is_low() itself
+static void handle_power_changed(bool low_power)
+{
+  animated_ab_set_enabled(!low_power);
+}
+
+static bool order_is_valid()
+{
+  uint8_t seen = 0;
+  for( int8_t i = 0; i < MAX_MESSAGES; i++ )
   {
-  persist_read_data(0x40, &msg1, sizeof(message_1_t));
-  persist_read_data(0x41, &msg2, sizeof(message_2_t));
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Found message from: %s",msg2.from_text);
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Subject: %s",msg2.subject_text);
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Text: %s",msg1.scroll_text);
-
-  header_time[3] = msg1.header_time;
-  strcpy(scroll_text[3],msg1.scroll_text);
-  strcpy(from_text[3],msg2.from_text);
-  strcpy(subject_text[3],msg2.subject_text);
-  strcpy(uuid_text[3],msg1.uuid_text);
-  account_id[3] = msg1.account_id;
-  deleted[3] = msg1.deleted;
+    int8_t slot = app_metadata.order[i];
+    if( slot < 0 || slot >= MAX_MESSAGES || (seen & SLOT_BIT(slot)) )
+      return false;
+    seen |= SLOT_BIT(slot);
   }
-  
-  if( persist_exists(0x50) )
+  return true;
+}
+
+// Puts persisted metadata back in range, whether it was written by an older
+// build or left half written
+static void validate_metadata()
+{
+  if( app_metadata.num_messages_filled < 0 || app_metadata.num_messages_filled > MAX_MESSAGES )
+    app_metadata.num_messages_filled = MAX_MESSAGES;
+  if( app_metadata.next_write_index < 0 || app_metadata.next_write_index >= MAX_MESSAGES )
+    app_metadata.next_write_index = 0;
+  if( app_metadata.low_power_threshold < 0 || app_metadata.low_power_threshold > 100 )
+    app_metadata.low_power_threshold = POWER_DEFAULT_THRESHOLD;
+  if( app_metadata.account_reserve < 0 || app_metadata.account_reserve >= MAX_MESSAGES )
+    app_metadata.account_reserve = DEFAULT_ACCOUNT_RESERVE;
+  if( app_metadata.eviction_policy < 0 || app_metadata.eviction_policy >= NUM_EVICTION_POLICIES )
+    app_metadata.eviction_policy = EVICT_PRIORITY;
+
+  // Older metadata only has the ring position; newest first walks back from it
+  if( !order_is_valid() )
   {
-  persist_read_data(0x50, &msg1, sizeof(message_1_t));
-  persist_read_data(0x51, &msg2, sizeof(message_2_t));
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Found message from: %s",msg2.from_text);
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Subject: %s",msg2.subject_text);
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Text: %s",msg1.scroll_text);
-
-  header_time[4] = msg1.header_time;
-  strcpy(scroll_text[4],msg1.scroll_text);
-  strcpy(from_text[4],msg2.from_text);
-  strcpy(subject_text[4],msg2.subject_text);
-  strcpy(uuid_text[4],msg1.uuid_text);
-  account_id[4] = msg1.account_id;
-  deleted[4] = msg1.deleted;
+    if( app_metadata.order[0] >= 0 )
+      LOG_ERROR(LOG_CAT_STORE, "Rebuilding corrupt message order");
+    for( int8_t i = 0; i < MAX_MESSAGES; i++ )
+      app_metadata.order[i] = (app_metadata.next_write_index-1-i+2*MAX_MESSAGES) % MAX_MESSAGES;
   }
-  
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Load complete.");
 }
 
 //
 // Handle the start-up of the app
 //
 static void do_init(void) {
+  uint32_t start = metrics_now();
 
   actions_enabled = 1;
   retries = 0;
+  service_in_flight = 0;
+  render_pending_slot = -1;
+#ifdef DEBUG_COMMANDS
+  injected_failures = 0;
+#endif
+  metrics_load(PERSIST_KEY_METRICS);
+  metrics_count(METRIC_COLD_STARTS, 1);
+
+  // Launched by the phone for new mail nobody is looking at yet
+  body_pending = 0;
+  kill_extensions = 0;
+  user_active = launch_reason() != APP_LAUNCH_PHONE;
   
-  if( persist_exists(0x0) )
-  {
-    persist_read_data(0x0, &app_metadata, sizeof(app_data_t));
-  }
-  else
+  // Defaults first, so fields added since the metadata was saved keep them
+  app_metadata.num_messages_filled = 0;
+  app_metadata.next_write_index = 0;
+  app_metadata.utc_offset = 0;
+  app_metadata.actions_enabled = 0;
+  app_metadata.low_power_threshold = POWER_DEFAULT_THRESHOLD;
+  app_metadata.order[0] = -1;
+  app_metadata.account_reserve = DEFAULT_ACCOUNT_RESERVE;
+  app_metadata.eviction_policy = EVICT_PRIORITY;
+  app_metadata.generation = 0;
+  memset(app_metadata.slot_generation, 0, sizeof(app_metadata.slot_generation));
+  if( persist_exists(PERSIST_KEY_METADATA) )
   {
-    app_metadata.num_messages_filled = 0;
-    app_metadata.next_write_index = 0;
-    app_metadata.utc_offset = 0;
-    app_metadata.actions_enabled = 0;
+    persist_read_data(PERSIST_KEY_METADATA, &app_metadata, sizeof(app_data_t));
   }
+  validate_metadata();
+  account_filtered = false;
+  view_count = 0;
+  filled_slots = 0;
+  for( int8_t i = 0; i < app_metadata.num_messages_filled; i++ )
+    filled_slots |= SLOT_BIT(app_metadata.order[i]);
+  deleted_slots = 0;
+  read_slots = 0;
+  priority_slots = 0;
+  unsaved_slots = 0;
+  accounts_load(PERSIST_KEY_ACCOUNTS);
   
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Num messages filled: %i",app_metadata.num_messages_filled);
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Next write index: %i",app_metadata.next_write_index);
+  LOG_DEBUG(LOG_CAT_STORE, "Num messages filled: %i",app_metadata.num_messages_filled);
 
   // Create our app's base window
   window = window_create();
   window_stack_push(window, true);
-  window_set_background_color(window, GColorBlack);
+  window_set_background_color(window, GColorWhite);
   
   Layer *root_layer = window_get_root_layer(window);
   GRect frame = layer_get_frame(root_layer);
 
   GRect bounds = layer_get_frame(root_layer);
+  page_height = bounds.size.h;
+  cursor = 0;
+  scroll_y = 0;
+  content_height = 0;
 
   // Initialize the scroll layer
   scroll_layer = scroll_layer_create(bounds);
@@ -1008,10 +2014,11 @@ static void do_init(void) {
   // You may use scroll_layer_set_callbacks to add or override interactivity
   //scroll_layer_set_click_config_onto_window(scroll_layer, window);
 
-  master_text_layer = text_layer_create(GRect(0,0,bounds.size.w,5*bounds.size.h));
-  text_layer_set_background_color(master_text_layer,GColorWhite);
-  scroll_layer_add_child(scroll_layer,text_layer_get_layer(master_text_layer));
-  
+  // Bodies are measured up to a few screens tall, longer ones are clipped
+  body_font = fonts_get_system_font(FONT_KEY_GOTHIC_14);
+  bold_font = fonts_get_system_font(FONT_KEY_GOTHIC_14_BOLD);
+  body_box = GSize(bounds.size.w-ACTION_BAR_WIDTH-5,4*bounds.size.h);
+
   bubble = gbitmap_create_with_resource(RESOURCE_ID_BUBBLE_BLACK);
   deleted_bubble = gbitmap_create_with_resource(RESOURCE_ID_DELETED_BLACK);
 
@@ -1022,74 +2029,40 @@ static void do_init(void) {
     strcpy(from_text[i],"...");
     strcpy(subject_text[i],"...");
   }
-  load_messages();
+  // Only the newest message is needed for the first frame; the rest of the
+  // store is read just after it has been drawn
+  slots_loaded = 0;
+  if( store_is_current() && app_metadata.num_messages_filled > 0 )
+    load_message(app_metadata.order[0]);
+  else
+    load_messages();
 
-  for( int i = 0; i < MAX_MESSAGES; i++ )
+  // One drawn layer per card, moved into place by layout_cards
+  for( int8_t i = 0; i < MAX_MESSAGES; i++ )
   {
-    GRect textBounds = GRect(2,(i*bounds.size.h)+62,bounds.size.w-ACTION_BAR_WIDTH-5,bounds.size.h-18-46-20);
-    GRect headerImageBounds = GRect(20,(i*bounds.size.h)+2,14,14);
-    GRect headerLabelBounds = GRect(40,(i*bounds.size.h),bounds.size.w-50-5,18);
-    GRect fromLabelBounds = GRect(2,(i*bounds.size.h)+16,bounds.size.w-ACTION_BAR_WIDTH-5,16);
-    GRect subjectLabelBounds = GRect(2,(i*bounds.size.h)+32,bounds.size.w-ACTION_BAR_WIDTH-5,30);
-    GRect footerBounds = GRect(2,(i*bounds.size.h)+62+textBounds.size.h,bounds.size.w-ACTION_BAR_WIDTH-5,30);
-    
-    text_layer[i] = text_layer_create(textBounds);
-    layer_set_clips(text_layer_get_layer(text_layer[i]), true);
-
-    header_bubble_layer[i] = bitmap_layer_create(headerImageBounds);
-    bitmap_layer_set_bitmap(header_bubble_layer[i], bubble);
-    
-    header_text_layer[i] = text_layer_create(headerLabelBounds);
-    text_layer_set_font(header_text_layer[i], fonts_get_system_font(FONT_KEY_GOTHIC_14));
-    text_layer_set_background_color(header_text_layer[i], GColorClear);
-    text_layer_set_text(header_text_layer[i], "Just Now");
-    layer_set_clips(text_layer_get_layer(header_text_layer[i]), false);
-    
-    footer_text_layer[i] = text_layer_create(footerBounds);
-    text_layer_set_font(footer_text_layer[i], fonts_get_system_font(FONT_KEY_GOTHIC_14_BOLD));
-    text_layer_set_background_color(footer_text_layer[i], GColorClear);
-    text_layer_set_text(footer_text_layer[i], "Empty");
-    text_layer_set_text_alignment(footer_text_layer[i], GTextAlignmentCenter);
-    layer_set_clips(text_layer_get_layer(footer_text_layer[i]), false);
-
-    from_text_layer[i] = text_layer_create(fromLabelBounds);
-    text_layer_set_font(from_text_layer[i], fonts_get_system_font(FONT_KEY_GOTHIC_14_BOLD));
-    text_layer_set_background_color(from_text_layer[i], GColorClear);
-    layer_set_clips(text_layer_get_layer(from_text_layer[i]), true);
-
-    subject_text_layer[i] = text_layer_create(subjectLabelBounds);
-    text_layer_set_font(subject_text_layer[i], fonts_get_system_font(FONT_KEY_GOTHIC_14_BOLD));
-    text_layer_set_background_color(subject_text_layer[i], GColorClear);
-    text_layer_set_overflow_mode(subject_text_layer[i], GTextOverflowModeFill);
-    layer_set_clips(text_layer_get_layer(subject_text_layer[i]), true);
-
-    
-    // Change the font to a nice readable one
-    // This is system font; you can inspect pebble_fonts.h for all system fonts
-    // or you can take a look at feature_custom_font to add your own font
-    text_layer_set_font(text_layer[i], fonts_get_system_font(FONT_KEY_GOTHIC_14));
-    text_layer_set_overflow_mode(text_layer[i], GTextOverflowModeFill);
-    
-    // Add the layers for display
-    scroll_layer_add_child(scroll_layer, text_layer_get_layer(text_layer[i]));
-    scroll_layer_add_child(scroll_layer, text_layer_get_layer(header_text_layer[i]));
-    scroll_layer_add_child(scroll_layer, bitmap_layer_get_layer(header_bubble_layer[i]));
-    scroll_layer_add_child(scroll_layer, text_layer_get_layer(from_text_layer[i]));
-    scroll_layer_add_child(scroll_layer, text_layer_get_layer(subject_text_layer[i]));   
-    scroll_layer_add_child(scroll_layer, text_layer_get_layer(footer_text_layer[i]));
+    card_layer[i] = layer_create_with_data(GRect(0,0,bounds.size.w,0), sizeof(int8_t));
+    *(int8_t*)layer_get_data(card_layer[i]) = i;
+    layer_set_update_proc(card_layer[i], card_update_proc);
+    scroll_layer_add_child(scroll_layer, card_layer[i]);
   }
 
+  // Also lays the cards out and sizes the scroll content to them
   refresh_screen();
 
-  // Trim text layer and scroll content to fit text box
-  scroll_layer_set_content_size(scroll_layer, GSize(bounds.size.w, 5*bounds.size.h));
-
   layer_add_child(root_layer, scroll_layer_get_layer(scroll_layer));
+
+  list_layer = layer_create(bounds);
+  layer_set_update_proc(list_layer, list_update_proc);
+  layer_set_hidden(list_layer, true);
+  layer_add_child(root_layer, list_layer);
   
   // Initialize the action bar:
   action_bar = action_bar_layer_create();
   // Associate the action bar with the window:
   action_bar_layer_add_to_window(action_bar, window);
+  animated_ab_init(action_bar, bounds);
+  power_init(app_metadata.low_power_threshold, handle_power_changed);
+  vibe_init(true);
   // Set the click config provider:
   action_bar_layer_set_click_config_provider(action_bar,
                                              click_config_provider);
@@ -1109,6 +2082,7 @@ static void do_init(void) {
   open = gbitmap_create_with_resource(RESOURCE_ID_OPEN_BLACK);
   
   mode = MODE_SCROLL;
+  icon_mode = MODE_SCROLL;
 
   deleteConfirmLayer = text_layer_create(GRect((bounds.size.w/2)-45,(bounds.size.h/2)-45,70,90));
   text_layer_set_background_color(deleteConfirmLayer, GColorBlack);
@@ -1158,43 +2132,57 @@ static void do_init(void) {
   app_message_register_outbox_failed(out_failed_handler);
   
   const int inbound_size = 120;
-  const int outbound_size = 120;
+  const int outbound_size = 120 + sizeof(metrics_t) + sizeof(accounts_t);
   app_message_open(inbound_size, outbound_size);   
   
-  kill_timer = app_timer_register(30*1000, handle_kill_timer, NULL);
+  kill_timer = app_timer_register(kill_timeout(), handle_kill_timer, NULL);
+  app_timer_register(DEFERRED_LOAD_MS, handle_deferred_load, NULL);
+
+  metrics_record_time(TIMER_LAUNCH, start);
+  metrics_record_max(METRIC_HEAP_USED, heap_bytes_used());
+  LOG_DEBUG(LOG_CAT_APP, "Heap used after launch: %d b", (int)heap_bytes_used());
 }
 
 static void check_persist_size()
 {
   int size = 0;
   
-  if( persist_exists(0x0) )
-    size = size + persist_get_size(0x0);
-  if( persist_exists(0x10) )
-    size = size + persist_get_size(0x10);
-  if( persist_exists(0x20) )
-    size = size + persist_get_size(0x20);
-  if( persist_exists(0x30) )
-    size = size + persist_get_size(0x30);
-  if( persist_exists(0x40) )
-    size = size + persist_get_size(0x40);
-  if( persist_exists(0x50) )
-    size = size + persist_get_size(0x50);
+  if( persist_exists(PERSIST_KEY_METADATA) )
+    size = size + persist_get_size(PERSIST_KEY_METADATA);
+  for( int8_t i = 0; i < MAX_MESSAGES; i++ )
+  {
+    if( persist_exists(PERSIST_KEY_MESSAGE(i)) )
+      size = size + persist_get_size(PERSIST_KEY_MESSAGE(i));
+    if( persist_exists(PERSIST_KEY_MESSAGE(i)+1) )
+      size = size + persist_get_size(PERSIST_KEY_MESSAGE(i)+1);
+  }
   
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Current storage: %d b",size);
+  LOG_DEBUG(LOG_CAT_STORE, "Current storage: %d b",size);
 }
 
 static void do_deinit(void) {
   
-  persist_write_data(0x0, &app_metadata, sizeof(app_data_t));
-  APP_LOG(APP_LOG_LEVEL_DEBUG, "Stored storage values to memory - Num Filled(%d) Next Index(%d)",app_metadata.num_messages_filled,app_metadata.next_write_index);
+  // Read state is only worth a write on the way out
+  for( int8_t i = 0; i < MAX_MESSAGES; i++ )
+  {
+    if( (unsaved_slots & slots_loaded) & SLOT_BIT(i) )
+      persist_messages(i);
+  }
+
+  persist_write_data(PERSIST_KEY_METADATA, &app_metadata, sizeof(app_data_t));
+  metrics_save(PERSIST_KEY_METRICS);
+  accounts_save(PERSIST_KEY_ACCOUNTS);
+  LOG_DEBUG(LOG_CAT_STORE, "Stored storage values to memory - Num Filled(%d) Newest(%d)",app_metadata.num_messages_filled,app_metadata.order[0]);
   check_persist_size();
   
+  vibe_deinit();
+  power_deinit();
+  animated_ab_deinit();
   action_bar_layer_destroy(action_bar);
   accel_tap_service_unsubscribe();
   tick_timer_service_unsubscribe();
   scroll_layer_destroy(scroll_layer);
-  text_layer_destroy(master_text_layer);
+  layer_destroy(list_layer);
   bitmap_layer_destroy(trashImageLayer);
   bitmap_layer_destroy(questionImageLayer);
   text_layer_destroy(deleteConfirmLayer);
@@ -1224,12 +2212,7 @@ static void do_deinit(void) {
   
   for( int i = 0; i < MAX_MESSAGES; i++ )
   {
-    text_layer_destroy(text_layer[i]);
-    text_layer_destroy(header_text_layer[i]);
-    bitmap_layer_destroy(header_bubble_layer[i]);
-    text_layer_destroy(from_text_layer[i]);
-    text_layer_destroy(subject_text_layer[i]);
-    text_layer_destroy(footer_text_layer[i]);
+    layer_destroy(card_layer[i]);
   }
   window_destroy(window);
 }
@@ -0,0 +1,38 @@
+#pragma once
+#include <pebble.h>
+
+// Compile-time gated logging. Calls above LOG_LEVEL, or in a category missing
+// from LOG_CATEGORIES, fold away along with their format strings. Both are
+// normally set by the build (see --log-level in wscript).
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_VERBOSE 5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_WARNING
+#endif
+
+#define LOG_CAT_APP 0x1
+#define LOG_CAT_MSG 0x2
+#define LOG_CAT_STORE 0x4
+#define LOG_CAT_UI 0x8
+
+#ifndef LOG_CATEGORIES
+#define LOG_CATEGORIES (LOG_CAT_APP | LOG_CAT_MSG | LOG_CAT_STORE | LOG_CAT_UI)
+#endif
+
+#define LOG_AT(level, app_level, category, fmt, args...) \
+  do { \
+    if( (level) <= LOG_LEVEL && ((category) & (LOG_CATEGORIES)) ) \
+      APP_LOG(app_level, fmt, ## args); \
+  } while(0)
+
+#define LOG_ERROR(category, fmt, args...) LOG_AT(LOG_LEVEL_ERROR, APP_LOG_LEVEL_ERROR, category, fmt, ## args)
+#define LOG_WARNING(category, fmt, args...) LOG_AT(LOG_LEVEL_WARNING, APP_LOG_LEVEL_WARNING, category, fmt, ## args)
+#define LOG_INFO(category, fmt, args...) LOG_AT(LOG_LEVEL_INFO, APP_LOG_LEVEL_INFO, category, fmt, ## args)
+#define LOG_DEBUG(category, fmt, args...) LOG_AT(LOG_LEVEL_DEBUG, APP_LOG_LEVEL_DEBUG, category, fmt, ## args)
+#define LOG_VERBOSE(category, fmt, args...) LOG_AT(LOG_LEVEL_VERBOSE, APP_LOG_LEVEL_DEBUG_VERBOSE, category, fmt, ## args)
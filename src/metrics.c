@@ -0,0 +1,105 @@
+#include <pebble.h>
+#include "metrics.h"
+#include "log.h"
+
+static metrics_t metrics;
+static const uint16_t bucket_bounds[NUM_METRIC_BUCKETS-1] = METRIC_BUCKET_BOUNDS_MS;
+static const metrics_layout_t layout = {
+  METRICS_LAYOUT_VERSION, NUM_METRIC_COUNTERS, NUM_METRIC_FAILURE_REASONS, NUM_METRIC_TIMERS, NUM_METRIC_BUCKETS
+};
+
+void metrics_reset()
+{
+  memset(&metrics, 0, sizeof(metrics_t));
+  metrics.layout = layout;
+}
+
+void metrics_load(uint32_t persist_key)
+{
+  // Drop counters saved by a build with a different layout
+  if( persist_exists(persist_key) && persist_get_size(persist_key) == sizeof(metrics_t) )
+    persist_read_data(persist_key, &metrics, sizeof(metrics_t));
+  if( memcmp(&metrics.layout, &layout, sizeof(metrics_layout_t)) != 0 )
+    metrics_reset();
+}
+
+void metrics_save(uint32_t persist_key)
+{
+  persist_write_data(persist_key, &metrics, sizeof(metrics_t));
+}
+
+void metrics_count(MetricCounter counter, uint32_t amount)
+{
+  metrics.counters[counter] += amount;
+}
+
+uint32_t metrics_get(MetricCounter counter)
+{
+  return metrics.counters[counter];
+}
+
+void metrics_record_max(MetricCounter counter, uint32_t value)
+{
+  if( value > metrics.counters[counter] )
+    metrics.counters[counter] = value;
+}
+
+void metrics_count_failure(AppMessageResult reason)
+{
+  metrics.counters[METRIC_OUTBOX_FAILURES]++;
+
+  for( uint8_t bit = 0; bit < NUM_METRIC_FAILURE_REASONS; bit++ )
+  {
+    if( reason & (1 << bit) )
+      metrics.failure_reasons[bit]++;
+  }
+}
+
+uint32_t metrics_now()
+{
+  time_t seconds;
+  uint16_t milliseconds;
+  time_ms(&seconds, &milliseconds);
+  return (uint32_t)seconds*1000 + milliseconds;
+}
+
+void metrics_record_time(MetricTimer timer, uint32_t start)
+{
+  uint32_t elapsed = metrics_now() - start;
+  if( elapsed > UINT16_MAX )
+    elapsed = UINT16_MAX;
+
+  metric_timer_t *t = &metrics.timers[timer];
+  if( t->count == 0 || elapsed < t->min_ms )
+    t->min_ms = elapsed;
+  if( elapsed > t->max_ms )
+    t->max_ms = elapsed;
+  t->total_ms += elapsed;
+  t->count++;
+
+  uint8_t bucket = 0;
+  while( bucket < NUM_METRIC_BUCKETS-1 && elapsed >= bucket_bounds[bucket] )
+    bucket++;
+  if( metrics.buckets[timer][bucket] < UINT16_MAX )
+    metrics.buckets[timer][bucket]++;
+}
+
+void metrics_write(DictionaryIterator *iter, uint32_t key)
+{
+  dict_write_data(iter, key, (const uint8_t*)&metrics, sizeof(metrics_t));
+}
+
+void metrics_log()
+{
+  for( int i = 0; i < NUM_METRIC_COUNTERS; i++ )
+    LOG_INFO(LOG_CAT_APP, "Counter %d: %u", i, (unsigned)metrics.counters[i]);
+
+  for( int i = 0; i < NUM_METRIC_TIMERS; i++ )
+  {
+    metric_timer_t *t = &metrics.timers[i];
+    LOG_INFO(LOG_CAT_APP, "Timer %d: n=%u min=%u avg=%u max=%u ms", i, (unsigned)t->count, t->min_ms,
+              t->count ? (unsigned)(t->total_ms/t->count) : 0, t->max_ms);
+    LOG_INFO(LOG_CAT_APP, "Timer %d buckets: %u %u %u %u %u", i, metrics.buckets[i][0], metrics.buckets[i][1],
+              metrics.buckets[i][2], metrics.buckets[i][3], metrics.buckets[i][4]);
+  }
+}
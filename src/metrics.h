@@ -0,0 +1,97 @@
+#pragma once
+#include <pebble.h>
+
+// Field counters and timings, kept across launches and dumped to the phone on
+// request. The wire format of metrics_write is the packed metrics_t below,
+// little endian, as a single byte array tuple. It opens with a layout header
+// giving the version and the length of each array, so the phone can find the
+// arrays after counters or timers are added. New counters and timers still go
+// at the end of their enums so the existing indices keep their meaning; bump
+// METRICS_LAYOUT_VERSION for any other change to metrics_t.
+
+typedef enum MetricCounter {
+  METRIC_INBOUND_MESSAGES,
+  METRIC_INBOUND_BYTES_COPIED,
+  METRIC_DEDUP_HITS,
+  METRIC_PERSIST_WRITES,
+  METRIC_PERSIST_BYTES,
+  METRIC_REFRESH_CALLS,
+  METRIC_LAYER_UPDATES,
+  METRIC_OUTBOX_SENT,
+  METRIC_OUTBOX_RETRIES,
+  METRIC_OUTBOX_FAILURES,
+  METRIC_INBOUND_OVER_BUDGET,
+  METRIC_BUTTON_PRESSES,
+  METRIC_ICON_SETS,
+  METRIC_COMMANDS,
+  METRIC_COLD_STARTS,
+  METRIC_IDLE_EXITS,
+  METRIC_KILL_EXTENSIONS,
+  METRIC_HEAP_USED,
+  NUM_METRIC_COUNTERS
+} MetricCounter;
+
+typedef enum MetricTimer {
+  TIMER_INBOUND,
+  TIMER_PERSIST,
+  TIMER_REFRESH,
+  TIMER_LAUNCH,
+  TIMER_NOTIFY_RENDER,
+  TIMER_COMMAND_ACK,
+  NUM_METRIC_TIMERS
+} MetricTimer;
+
+// AppMessageResult values are single bits; failures are counted per bit
+#define NUM_METRIC_FAILURE_REASONS 15
+
+typedef struct metric_timer_t
+{
+  uint32_t count;
+  uint32_t total_ms;
+  uint16_t min_ms;
+  uint16_t max_ms;
+} __attribute__((__packed__)) metric_timer_t;
+
+// Each timer also keeps a histogram of its samples, bucketed at these upper
+// bounds with a last bucket for anything slower
+#define METRIC_BUCKET_BOUNDS_MS { 50, 100, 250, 1000 }
+#define NUM_METRIC_BUCKETS 5
+
+#define METRICS_LAYOUT_VERSION 1
+
+typedef struct metrics_layout_t
+{
+  uint8_t version;
+  uint8_t num_counters;
+  uint8_t num_failure_reasons;
+  uint8_t num_timers;
+  uint8_t num_buckets;
+} __attribute__((__packed__)) metrics_layout_t;
+
+// Saved as a single persist record, so this has to stay within
+// PERSIST_DATA_MAX_LENGTH
+typedef struct metrics_t
+{
+  metrics_layout_t layout;
+  uint32_t counters[NUM_METRIC_COUNTERS];
+  uint16_t failure_reasons[NUM_METRIC_FAILURE_REASONS];
+  metric_timer_t timers[NUM_METRIC_TIMERS];
+  uint16_t buckets[NUM_METRIC_TIMERS][NUM_METRIC_BUCKETS];
+} __attribute__((__packed__)) metrics_t;
+
+void metrics_load(uint32_t persist_key);
+void metrics_save(uint32_t persist_key);
+void metrics_reset();
+
+void metrics_count(MetricCounter counter, uint32_t amount);
+uint32_t metrics_get(MetricCounter counter);
+// For counters that track a high-water mark rather than a total
+void metrics_record_max(MetricCounter counter, uint32_t value);
+void metrics_count_failure(AppMessageResult reason);
+
+// Millisecond timestamp to pass back to metrics_record_time
+uint32_t metrics_now();
+void metrics_record_time(MetricTimer timer, uint32_t start);
+
+void metrics_write(DictionaryIterator *iter, uint32_t key);
+void metrics_log();
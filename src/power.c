@@ -0,0 +1,61 @@
+#include <pebble.h>
+#include "power.h"
+#include "log.h"
+
+// How long a light_enable_interaction lasts
+#define LIGHT_INTERACTION_S 3
+
+static uint8_t threshold;
+static bool low_power;
+static time_t last_light;
+static PowerChangedHandler changed_handler;
+
+static void update_power_state(BatteryChargeState charge)
+{
+  bool low = !charge.is_plugged && charge.charge_percent <= threshold;
+  if( low == low_power )
+    return;
+
+  low_power = low;
+  LOG_INFO(LOG_CAT_APP, "Low power mode %s at %d%%", low ? "on" : "off", charge.charge_percent);
+  if( changed_handler )
+    changed_handler(low_power);
+}
+
+void power_init(uint8_t threshold_percent, PowerChangedHandler handler)
+{
+  threshold = threshold_percent;
+  changed_handler = handler;
+  low_power = false;
+  last_light = 0;
+
+  update_power_state(battery_state_service_peek());
+  battery_state_service_subscribe(update_power_state);
+}
+
+void power_deinit(void)
+{
+  battery_state_service_unsubscribe();
+}
+
+void power_set_threshold(uint8_t threshold_percent)
+{
+  threshold = threshold_percent;
+  update_power_state(battery_state_service_peek());
+}
+
+bool power_is_low(void)
+{
+  return low_power;
+}
+
+void power_light_interaction(bool user_input)
+{
+  time_t now = time(NULL);
+
+  if( low_power && (!user_input || now - last_light < LIGHT_INTERACTION_S) )
+    return;
+
+  last_light = now;
+  light_enable_interaction();
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <pebble.h>
+
+// Battery aware policy for the backlight, animations and vibes. Below the
+// threshold charge (and not plugged in) the app runs in low power mode.
+
+#define POWER_DEFAULT_THRESHOLD 20
+
+typedef void (*PowerChangedHandler)(bool low_power);
+
+void power_init(uint8_t threshold_percent, PowerChangedHandler handler);
+void power_deinit(void);
+void power_set_threshold(uint8_t threshold_percent);
+
+bool power_is_low(void);
+
+// Lights the backlight for an interaction unless that would be redundant in
+// low power mode: inbound messages never light it, and presses only re-light
+// it once the previous interaction light has run out.
+void power_light_interaction(bool user_input);
@@ -0,0 +1,129 @@
+#include <pebble.h>
+#include "text_codec.h"
+
+#define CODE_FIRST 0x80
+#define CODE_ESCAPE 0xFF
+
+typedef struct codec_entry_t
+{
+  const char *text;
+  uint8_t length;
+} codec_entry_t;
+
+#define ENTRY(s) { s, sizeof(s)-1 }
+
+// Common fragments of English mail, longest first within each group so the
+// greedy encoder tends to settle on the bigger win. At most 127 entries.
+static const codec_entry_t dictionary[] = {
+  ENTRY(" please"), ENTRY("Thank you"), ENTRY(" thanks"), ENTRY("Thanks"), ENTRY("Hello"),
+  ENTRY(" that"), ENTRY(" with"), ENTRY(" have"), ENTRY(" this"), ENTRY(" will"),
+  ENTRY(" your"), ENTRY(" from"), ENTRY(" the "), ENTRY(" and "), ENTRY(" for "),
+  ENTRY("Fwd: "), ENTRY(" to "), ENTRY(" of "), ENTRY(" you"), ENTRY(" in "),
+  ENTRY(" is "), ENTRY(" on "), ENTRY(" be "), ENTRY(" are"), ENTRY(" we "),
+  ENTRY(" it "), ENTRY(" at "), ENTRY(" can"), ENTRY(" not"), ENTRY(" as "),
+  ENTRY(" if "), ENTRY(" me "), ENTRY(" our"), ENTRY(" an "), ENTRY(" all"),
+  ENTRY(" by "), ENTRY(" or "), ENTRY("Re: "), ENTRY("Hi "), ENTRY("ing "),
+  ENTRY("tion"), ENTRY("ment"), ENTRY("ould"), ENTRY("ight"), ENTRY("ther"),
+  ENTRY("here"), ENTRY("ever"), ENTRY("ness"), ENTRY("ally"), ENTRY("ence"),
+  ENTRY("ance"), ENTRY("able"), ENTRY("ing"), ENTRY("ter"), ENTRY("ent"),
+  ENTRY("ion"), ENTRY("ers"), ENTRY("est"), ENTRY("all"), ENTRY("and"),
+  ENTRY("our"), ENTRY("ate"), ENTRY("ere"), ENTRY("ver"), ENTRY("com"),
+  ENTRY("pro"), ENTRY("con"), ENTRY("per"), ENTRY("ted"), ENTRY("ill"),
+  ENTRY("ed "), ENTRY("es "), ENTRY("s "), ENTRY("e "), ENTRY("t "),
+  ENTRY("d "), ENTRY("y "), ENTRY(". "), ENTRY(", "), ENTRY("th"),
+  ENTRY("he"), ENTRY("in"), ENTRY("er"), ENTRY("an"), ENTRY("re"),
+  ENTRY("on"), ENTRY("at"), ENTRY("en"), ENTRY("nd"), ENTRY("ti"),
+  ENTRY("es"), ENTRY("or"), ENTRY("te"), ENTRY("of"), ENTRY("ed"),
+  ENTRY("is"), ENTRY("it"), ENTRY("al"), ENTRY("ar"), ENTRY("st"),
+  ENTRY("to"), ENTRY("nt"), ENTRY("ng"), ENTRY("se"), ENTRY("ha"),
+  ENTRY("as"), ENTRY("ou"), ENTRY("io"), ENTRY("le"), ENTRY("ve"),
+  ENTRY("co"), ENTRY("me"), ENTRY("de"), ENTRY("hi"), ENTRY("ri"),
+  ENTRY("ro"), ENTRY("ic"), ENTRY("ne"), ENTRY("ea"), ENTRY("ra"),
+  ENTRY("ce"), ENTRY("li"), ENTRY("ch"), ENTRY("ll"), ENTRY("be"),
+  ENTRY("om"), ENTRY("ur"),
+};
+
+#define NUM_ENTRIES (sizeof(dictionary)/sizeof(dictionary[0]))
+
+int text_codec_encode(const char *src, uint8_t *dest, size_t dest_size)
+{
+  size_t out = 0;
+
+  while( *src )
+  {
+    // Greedy longest match against the dictionary
+    int best = -1;
+    uint8_t best_length = 1;
+    for( size_t i = 0; i < NUM_ENTRIES; i++ )
+    {
+      const codec_entry_t *entry = &dictionary[i];
+      if( entry->text[0] != *src || entry->length <= best_length )
+        continue;
+      if( strncmp(src, entry->text, entry->length) == 0 )
+      {
+        best = i;
+        best_length = entry->length;
+      }
+    }
+
+    if( best >= 0 )
+    {
+      if( out+1 > dest_size )
+        return -1;
+      dest[out++] = CODE_FIRST + best;
+      src += best_length;
+    }
+    else if( (uint8_t)*src >= CODE_FIRST )
+    {
+      if( out+2 > dest_size )
+        return -1;
+      dest[out++] = CODE_ESCAPE;
+      dest[out++] = (uint8_t)*src++;
+    }
+    else
+    {
+      if( out+1 > dest_size )
+        return -1;
+      dest[out++] = (uint8_t)*src++;
+    }
+  }
+
+  return out;
+}
+
+size_t text_codec_decode(const uint8_t *src, size_t src_length, char *dest, size_t dest_size)
+{
+  if( dest_size == 0 )
+    return 0;
+
+  size_t out = 0;
+  size_t limit = dest_size-1;
+
+  for( size_t i = 0; i < src_length && out < limit; i++ )
+  {
+    uint8_t code = src[i];
+
+    if( code < CODE_FIRST )
+    {
+      dest[out++] = code;
+    }
+    else if( code == CODE_ESCAPE )
+    {
+      if( ++i >= src_length )
+        break;
+      dest[out++] = src[i];
+    }
+    else if( code-CODE_FIRST < (int)NUM_ENTRIES )
+    {
+      const codec_entry_t *entry = &dictionary[code-CODE_FIRST];
+      uint8_t length = entry->length;
+      if( length > limit-out )
+        length = limit-out;
+      memcpy(&dest[out], entry->text, length);
+      out += length;
+    }
+  }
+
+  dest[out] = '\0';
+  return out;
+}
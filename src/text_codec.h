@@ -0,0 +1,15 @@
+#pragma once
+#include <pebble.h>
+
+// Static-dictionary codec for short English mail text.
+//
+// Bytes below 0x80 are literals, 0x80-0xFE index the built-in dictionary and
+// 0xFF escapes the next byte so any input (including UTF-8) round trips.
+
+// Encodes the NUL terminated src into dest. Returns the encoded length, or -1
+// if the result does not fit in dest_size bytes.
+int text_codec_encode(const char *src, uint8_t *dest, size_t dest_size);
+
+// Decodes src_length bytes into dest, truncating to dest_size-1 characters.
+// dest is always NUL terminated. Returns the decoded length.
+size_t text_codec_decode(const uint8_t *src, size_t src_length, char *dest, size_t dest_size);
@@ -0,0 +1,93 @@
+#include <pebble.h>
+#include "vibe.h"
+#include "power.h"
+#include "log.h"
+
+// Requests closer together than this belong to the same burst
+#define VIBE_BURST_MS 3000
+#define VIBE_PULSE_MS 100
+#define VIBE_SUMMARY_MAX_PULSES 3
+
+static AppTimer *burst_timer;
+static uint8_t merged;
+static bool summary_enabled;
+
+// Alternating on/off segments, cut short to the number of pulses wanted
+static const uint32_t summary_segments[VIBE_SUMMARY_MAX_PULSES*2-1] = {
+  VIBE_PULSE_MS, VIBE_PULSE_MS, VIBE_PULSE_MS, VIBE_PULSE_MS, VIBE_PULSE_MS,
+};
+
+static void play(uint8_t pattern)
+{
+  switch(pattern)
+  {
+    case VIBE_PATTERN_SHORT:
+    vibes_short_pulse();
+    break;
+    
+    case VIBE_PATTERN_LONG:
+    vibes_long_pulse();
+    break;
+    
+    case VIBE_PATTERN_DOUBLE:
+    vibes_double_pulse();
+    break;
+    
+    default:
+    break;
+  }
+}
+
+static void handle_burst_timer(void *data)
+{
+  burst_timer = NULL;
+
+  // Low power mode settles for the vibe at the start of the burst, as does a
+  // burst of two
+  if( merged > 1 && summary_enabled && !power_is_low() )
+  {
+    uint8_t pulses = merged < VIBE_SUMMARY_MAX_PULSES ? merged : VIBE_SUMMARY_MAX_PULSES;
+    VibePattern summary = {
+      .durations = summary_segments,
+      .num_segments = pulses*2-1,
+    };
+    vibes_enqueue_custom_pattern(summary);
+  }
+
+  LOG_DEBUG(LOG_CAT_APP, "Vibe burst over, %d merged", merged);
+  merged = 0;
+}
+
+void vibe_init(bool count_summary)
+{
+  summary_enabled = count_summary;
+  burst_timer = NULL;
+  merged = 0;
+}
+
+void vibe_deinit(void)
+{
+  if( burst_timer )
+  {
+    app_timer_cancel(burst_timer);
+    burst_timer = NULL;
+  }
+}
+
+void vibe_request(uint8_t pattern)
+{
+  if( pattern >= NUM_VIBE_PATTERNS )
+    return;
+
+  if( burst_timer == NULL )
+  {
+    play(pattern);
+    burst_timer = app_timer_register(VIBE_BURST_MS, handle_burst_timer, NULL);
+    return;
+  }
+
+  // Part of a burst: hold it back and keep the burst open
+  if( merged < UINT8_MAX )
+    merged++;
+  app_timer_reschedule(burst_timer, VIBE_BURST_MS);
+}
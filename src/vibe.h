@@ -0,0 +1,22 @@
+#pragma once
+#include <pebble.h>
+
+// Coalesces vibes during inbound bursts. The first request after a quiet
+// spell fires straight away; requests that follow within the burst window are
+// merged, and once the burst is over a single pattern with one pulse per
+// merged message (up to a few) is played instead of a pulse each. A lone
+// merged request is covered by the vibe that opened the burst. Patterns
+// outside VibePatterns ask for no vibe and take no part in a burst.
+
+enum VibePatterns {
+  VIBE_PATTERN_SHORT = 0x0,
+  VIBE_PATTERN_LONG = 0x1,
+  VIBE_PATTERN_DOUBLE = 0x2,
+  NUM_VIBE_PATTERNS
+};
+
+// With count_summary off, merged requests are dropped rather than summarised
+void vibe_init(bool count_summary);
+void vibe_deinit(void);
+
+void vibe_request(uint8_t pattern);
@@ -0,0 +1,316 @@
+// Replays phone traffic through in_received_handler and reports what each
+// inbound message costs: CPU time, bytes copied out of the dictionary,
+// persist bytes written and layer updates. Exits non-zero if any message
+// goes over the app's own INBOUND_BUDGET_* limits or the bytes copied
+// budget, or a sequence's mean time goes over the CPU budget.
+//
+//   bench_receive [corpus [budget_us [rounds]]]
+//
+// Sequences, each replayed rounds times from a fresh launch by the phone:
+//   pairs        header and body for each corpus line, a second apart
+//   duplicates   the same headers and bodies sent again
+//   burst        50 mails back to back, long bodies in appended chunks
+//   interleaved  mails with KEY_UTC_OFFSET and KEY_ACTION_SUPPORT between
+#include "enotify_host.h"
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_LINES 256
+#define MAX_LINE 512
+#define MAX_STEPS 512
+#define INBOX_SIZE 120
+#define BODY_CHUNK 80
+#define BURST_MAILS 50
+
+// A header copies the UUID, sender and subject; a body chunk at most a slot
+#define BUDGET_BYTES_COPIED (3*MAX_TEXT_LENGTH)
+#define DEFAULT_BUDGET_US 200
+
+enum StepKinds {
+  STEP_HEADER,
+  STEP_BODY,
+  STEP_DUPLICATE,
+  STEP_OFFSET,
+  STEP_ACTION_SUPPORT,
+  NUM_STEP_KINDS
+};
+
+static const char *kind_names[NUM_STEP_KINDS] = {
+  [STEP_HEADER] = "header",
+  [STEP_BODY] = "body",
+  [STEP_DUPLICATE] = "duplicate",
+  [STEP_OFFSET] = "offset",
+  [STEP_ACTION_SUPPORT] = "actions",
+};
+
+// One recorded dictionary and the virtual time to let pass before it
+typedef struct step_t {
+  uint8_t kind;
+  uint32_t delay_ms;
+  uint16_t size;
+  uint8_t data[INBOX_SIZE];
+} step_t;
+
+typedef struct sequence_t {
+  const char *name;
+  int count;
+  step_t steps[MAX_STEPS];
+} sequence_t;
+
+typedef struct cost_t {
+  uint32_t count;
+  double total_us;
+  double max_us;
+  uint32_t max_copied;
+  uint32_t max_persist_bytes;
+  uint32_t max_layer_updates;
+  uint32_t over_budget;
+} cost_t;
+
+static char lines[MAX_LINES][MAX_LINE];
+static int num_lines;
+static int mails;
+
+static double now_us()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec*1e6 + now.tv_nsec/1e3;
+}
+
+static void record(sequence_t *sequence, uint8_t kind, uint32_t delay_ms, app_dict_t *dict)
+{
+  uint32_t size = dict_write_end(&dict->iter);
+  if( sequence->count >= MAX_STEPS || size > INBOX_SIZE )
+  {
+    fprintf(stderr, "%s: step %d does not fit\n", sequence->name, sequence->count);
+    exit(2);
+  }
+  step_t *step = &sequence->steps[sequence->count++];
+  step->kind = kind;
+  step->delay_ms = delay_ms;
+  step->size = size;
+  memcpy(step->data, dict->buffer, size);
+}
+
+// A header with the line's start as its subject and a vibe, then the body in
+// chunks that fit the inbox, text_codec encoded for every other mail
+static void record_mail(sequence_t *sequence, int mail, const char *text, uint32_t delay_ms, uint8_t kind)
+{
+  char uuid[16];
+  snprintf(uuid, sizeof(uuid), "m%05d", mail);
+  char subject[33];
+  strncpy(subject, text, sizeof(subject)-1);
+  subject[sizeof(subject)-1] = '\0';
+
+  app_dict_t dict;
+  DictionaryIterator *iter = app_dict_begin(&dict);
+  dict_write_cstring(iter, KEY_MSG_UUID, uuid);
+  dict_write_int32(iter, KEY_MSG_TIME, (int32_t)(host_clock - 60));
+  dict_write_cstring(iter, KEY_MSG_FROM, "someone@example.com");
+  dict_write_cstring(iter, KEY_MSG_SUBJECT, subject);
+  dict_write_uint32(iter, KEY_ACCOUNT_ID, 1 + mail%3);
+  dict_write_uint8(iter, KEY_VIBE_PATTERN, VIBE_PATTERN_SHORT);
+  record(sequence, kind == STEP_DUPLICATE ? STEP_DUPLICATE : STEP_HEADER, delay_ms, &dict);
+
+  size_t length = strlen(text);
+  if( length > MAX_TEXT_LENGTH-1 )
+    length = MAX_TEXT_LENGTH-1;
+  bool codec = mail % 2 == 0;
+  for( size_t at = 0; at < length || at == 0; at += BODY_CHUNK )
+  {
+    char chunk[BODY_CHUNK+1];
+    size_t size = length-at < BODY_CHUNK ? length-at : BODY_CHUNK;
+    memcpy(chunk, &text[at], size);
+    chunk[size] = '\0';
+
+    uint8_t encoding = (at > 0 ? MSG_ENCODING_APPEND : 0) | (at+size < length ? MSG_ENCODING_MORE : 0);
+    iter = app_dict_begin(&dict);
+    dict_write_cstring(iter, KEY_MSG_UUID, uuid);
+    if( codec )
+    {
+      uint8_t encoded[2*BODY_CHUNK];
+      int encoded_length = text_codec_encode(chunk, encoded, sizeof(encoded));
+      dict_write_uint8(iter, KEY_MSG_ENCODING, encoding | MSG_ENCODING_CODEC);
+      dict_write_data(iter, KEY_MSG_TEXT, encoded, encoded_length);
+    }
+    else
+    {
+      if( encoding )
+        dict_write_uint8(iter, KEY_MSG_ENCODING, encoding);
+      dict_write_cstring(iter, KEY_MSG_TEXT, chunk);
+    }
+    record(sequence, STEP_BODY, 0, &dict);
+    if( length == 0 )
+      break;
+  }
+}
+
+static void record_int(sequence_t *sequence, uint8_t kind, uint32_t key, int32_t value)
+{
+  app_dict_t dict;
+  dict_write_int32(app_dict_begin(&dict), key, value);
+  record(sequence, kind, 0, &dict);
+}
+
+static void build_pairs(sequence_t *sequence)
+{
+  sequence->name = "pairs";
+  for( int i = 0; i < num_lines; i++ )
+    record_mail(sequence, mails++, lines[i], 1000, STEP_HEADER);
+}
+
+static void build_duplicates(sequence_t *sequence)
+{
+  sequence->name = "duplicates";
+  int first = mails;
+  for( int i = 0; i < MAX_MESSAGES; i++ )
+    record_mail(sequence, mails++, lines[i % num_lines], 1000, STEP_HEADER);
+  for( int round = 0; round < 4; round++ )
+  {
+    for( int i = 0; i < MAX_MESSAGES; i++ )
+      record_mail(sequence, first+i, lines[i % num_lines], 0, STEP_DUPLICATE);
+  }
+}
+
+static void build_burst(sequence_t *sequence)
+{
+  sequence->name = "burst";
+  for( int i = 0; i < BURST_MAILS; i++ )
+    record_mail(sequence, mails++, lines[i % num_lines], 0, STEP_HEADER);
+}
+
+static void build_interleaved(sequence_t *sequence)
+{
+  sequence->name = "interleaved";
+  for( int i = 0; i < BURST_MAILS; i++ )
+  {
+    if( i % 5 == 0 )
+      record_int(sequence, STEP_OFFSET, KEY_UTC_OFFSET, (i/5 % 2) ? 3600 : 7200);
+    if( i % 7 == 0 )
+      record_int(sequence, STEP_ACTION_SUPPORT, KEY_ACTION_SUPPORT, i % 2);
+    record_mail(sequence, mails++, lines[i % num_lines], 200, STEP_HEADER);
+  }
+}
+
+static void replay(const sequence_t *sequence, cost_t *costs)
+{
+  host_reset();
+  app_launch(APP_LAUNCH_PHONE);
+  host_advance(DEFERRED_LOAD_MS);
+  host_outbox_complete(APP_MSG_OK);
+
+  for( int i = 0; i < sequence->count; i++ )
+  {
+    const step_t *step = &sequence->steps[i];
+    host_advance(step->delay_ms);
+
+    uint32_t copied = metrics_get(METRIC_INBOUND_BYTES_COPIED);
+    uint32_t layer_updates = metrics_get(METRIC_LAYER_UPDATES);
+    uint32_t persist_bytes = host_counters.persist_bytes;
+    double start = now_us();
+    host_receive(step->data, step->size);
+    double elapsed = now_us() - start;
+
+    copied = metrics_get(METRIC_INBOUND_BYTES_COPIED) - copied;
+    layer_updates = metrics_get(METRIC_LAYER_UPDATES) - layer_updates;
+    persist_bytes = host_counters.persist_bytes - persist_bytes;
+
+    cost_t *cost = &costs[step->kind];
+    cost->count++;
+    cost->total_us += elapsed;
+    if( elapsed > cost->max_us )
+      cost->max_us = elapsed;
+    if( copied > cost->max_copied )
+      cost->max_copied = copied;
+    if( persist_bytes > cost->max_persist_bytes )
+      cost->max_persist_bytes = persist_bytes;
+    if( layer_updates > cost->max_layer_updates )
+      cost->max_layer_updates = layer_updates;
+    if( copied > BUDGET_BYTES_COPIED || persist_bytes > INBOUND_BUDGET_PERSIST_BYTES || layer_updates > INBOUND_BUDGET_LAYER_UPDATES )
+      cost->over_budget++;
+
+    // The phone waits for each message to be acked, so anything the app
+    // sends in between goes out before the next one
+    if( host_outbox_pending() )
+      host_outbox_complete(APP_MSG_OK);
+  }
+  do_deinit();
+}
+
+static bool report(const sequence_t *sequence, int rounds, double budget_us)
+{
+  cost_t costs[NUM_STEP_KINDS];
+  memset(costs, 0, sizeof(costs));
+  for( int round = 0; round < rounds; round++ )
+    replay(sequence, costs);
+
+  bool ok = true;
+  uint32_t count = 0;
+  double total_us = 0;
+  for( int kind = 0; kind < NUM_STEP_KINDS; kind++ )
+  {
+    const cost_t *cost = &costs[kind];
+    if( cost->count == 0 )
+      continue;
+    count += cost->count;
+    total_us += cost->total_us;
+    printf("  %-12s %-10s %6u msgs %7.2f us mean %8.2f us max %4u copied %4u persist bytes %3u layer updates%s\n",
+           sequence->name, kind_names[kind], (unsigned)(cost->count/rounds), cost->total_us/cost->count, cost->max_us,
+           (unsigned)cost->max_copied, (unsigned)cost->max_persist_bytes, (unsigned)cost->max_layer_updates,
+           cost->over_budget ? "  OVER BUDGET" : "");
+    if( cost->over_budget )
+      ok = false;
+  }
+  if( total_us/count > budget_us )
+  {
+    printf("  %-12s mean %.2f us per message is over the %.0f us budget\n", sequence->name, total_us/count, budget_us);
+    ok = false;
+  }
+
+  // Duplicate headers are dropped before anything is copied or saved. A body
+  // sent again replaces the newest message's and is costed as a body.
+  if( costs[STEP_DUPLICATE].max_copied > 0 || costs[STEP_DUPLICATE].max_persist_bytes > 0 )
+  {
+    printf("  %-12s duplicates were copied or saved\n", sequence->name);
+    ok = false;
+  }
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  const char *path = argc > 1 ? argv[1] : "corpus.txt";
+  double budget_us = argc > 2 ? atof(argv[2]) : DEFAULT_BUDGET_US;
+  int rounds = argc > 3 ? atoi(argv[3]) : 200;
+
+  FILE *corpus = fopen(path, "r");
+  if( corpus == NULL )
+  {
+    perror(path);
+    return 1;
+  }
+  while( num_lines < MAX_LINES && fgets(lines[num_lines], MAX_LINE, corpus) )
+  {
+    lines[num_lines][strcspn(lines[num_lines], "\n")] = '\0';
+    num_lines++;
+  }
+  fclose(corpus);
+  if( num_lines == 0 )
+    return 1;
+
+  static sequence_t sequences[4];
+  build_pairs(&sequences[0]);
+  build_duplicates(&sequences[1]);
+  build_burst(&sequences[2]);
+  build_interleaved(&sequences[3]);
+
+  printf("bench_receive: %d rounds, budgets %d bytes copied, %d persist bytes, %d layer updates, %.0f us mean\n",
+         rounds, BUDGET_BYTES_COPIED, INBOUND_BUDGET_PERSIST_BYTES, INBOUND_BUDGET_LAYER_UPDATES, budget_us);
+  bool ok = true;
+  for( int i = 0; i < 4; i++ )
+    ok = report(&sequences[i], rounds, budget_us) && ok;
+
+  printf("bench_receive: %s\n", ok ? "OK" : "OVER BUDGET");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+// Compression ratio and speed of src/text_codec.c over a corpus with one
+// message text per line.
+#include <pebble.h>
+#include <stdlib.h>
+#include <time.h>
+#include "text_codec.h"
+
+#define MAX_TEXT 512
+#define MAX_LINES 1024
+
+static double seconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec/1e9;
+}
+
+int main(int argc, char **argv)
+{
+  const char *path = argc > 1 ? argv[1] : "corpus.txt";
+  int rounds = argc > 2 ? atoi(argv[2]) : 2000;
+
+  FILE *corpus = fopen(path, "r");
+  if( corpus == NULL )
+  {
+    perror(path);
+    return 1;
+  }
+
+  static char lines[MAX_LINES][MAX_TEXT];
+  int count = 0;
+  while( count < MAX_LINES && fgets(lines[count], MAX_TEXT, corpus) )
+  {
+    lines[count][strcspn(lines[count], "\n")] = '\0';
+    count++;
+  }
+  fclose(corpus);
+
+  static uint8_t encoded[MAX_LINES][2*MAX_TEXT];
+  static int encoded_length[MAX_LINES];
+  size_t raw_bytes = 0, encoded_bytes = 0;
+  for( int i = 0; i < count; i++ )
+  {
+    encoded_length[i] = text_codec_encode(lines[i], encoded[i], sizeof(encoded[i]));
+    raw_bytes += strlen(lines[i]);
+    encoded_bytes += encoded_length[i];
+  }
+
+  double start = seconds();
+  for( int r = 0; r < rounds; r++ )
+  {
+    for( int i = 0; i < count; i++ )
+      text_codec_encode(lines[i], encoded[i], sizeof(encoded[i]));
+  }
+  double encode_time = seconds() - start;
+
+  char decoded[MAX_TEXT];
+  start = seconds();
+  for( int r = 0; r < rounds; r++ )
+  {
+    for( int i = 0; i < count; i++ )
+      text_codec_decode(encoded[i], encoded_length[i], decoded, sizeof(decoded));
+  }
+  double decode_time = seconds() - start;
+
+  double mb = (double)raw_bytes*rounds/1e6;
+  printf("%s: %d texts, %zu bytes -> %zu bytes, ratio %.2f\n", path, count, raw_bytes, encoded_bytes, (double)encoded_bytes/raw_bytes);
+  printf("encode %.1f MB/s, decode %.1f MB/s\n", mb/encode_time, mb/decode_time);
+  return 0;
+}
@@ -0,0 +1,105 @@
+#pragma once
+// The app built into a host test, so the test can call its static functions
+// and look at its state. Include this instead of pebble.h, once per test.
+#define main enotify_main
+#include "../src/enotify.c"
+#undef main
+
+// The watch starts every launch with zeroed statics; here the app stays in
+// memory, so its state is cleared by hand. This is every zero initialized
+// static in enotify.c (nm enotify.o lists them as 'b').
+#define ZERO(name) memset(&name, 0, sizeof(name))
+static inline void clear_app()
+{
+  ZERO(account_filter); ZERO(account_filtered); ZERO(account_id); ZERO(action_bar);
+  ZERO(actions_enabled); ZERO(app_metadata); ZERO(body_box); ZERO(body_font); ZERO(body_height);
+  ZERO(body_pending); ZERO(bold_font); ZERO(bubble); ZERO(card_layer); ZERO(card_offset);
+  ZERO(command_start); ZERO(content_height); ZERO(cursor); ZERO(deleteConfirmLayer);
+  ZERO(deleted_bubble); ZERO(deleted_slots); ZERO(downArrow); ZERO(errorConfirmationTextLayer);
+  ZERO(errorImageLayer); ZERO(errorLayer); ZERO(error_hide_timer); ZERO(error_icon);
+  ZERO(filled_slots); ZERO(footer_text); ZERO(from_text); ZERO(header_text); ZERO(header_time);
+  ZERO(icon_mode); ZERO(inbound_start);
+  ZERO(kill_extensions); ZERO(kill_timer); ZERO(list_layer); ZERO(mode); ZERO(msg_account);
+  ZERO(msg_cmd); ZERO(msg_send_index); ZERO(msg_uuid); ZERO(open); ZERO(page_height);
+  ZERO(pressAgainTextLayer); ZERO(priority_slots); ZERO(question); ZERO(questionImageLayer);
+  ZERO(read_slots); ZERO(render_pending_slot); ZERO(render_start); ZERO(reply1); ZERO(reply2);
+  ZERO(retries); ZERO(scroll_layer); ZERO(scroll_text); ZERO(scroll_y); ZERO(service_in_flight);
+  ZERO(slots_loaded); ZERO(subject_text); ZERO(trash); ZERO(trashImageLayer); ZERO(trashWhite);
+  ZERO(unsaved_slots); ZERO(upArrow); ZERO(user_active); ZERO(uuid_text); ZERO(view);
+  ZERO(view_count); ZERO(window);
+#ifdef DEBUG_COMMANDS
+  ZERO(injected_failure); ZERO(injected_failures);
+#endif
+}
+
+// Launches the app the way the watch would, from zeroed statics
+static inline void app_launch(AppLaunchReason reason)
+{
+  clear_app();
+  host_launch_reason = reason;
+  do_init();
+}
+
+//
+// Dictionaries from the phone
+//
+
+#define APP_MAX_DICT 256
+
+typedef struct app_dict_t {
+  DictionaryIterator iter;
+  uint8_t buffer[APP_MAX_DICT];
+} app_dict_t;
+
+static inline DictionaryIterator* app_dict_begin(app_dict_t *dict)
+{
+  dict_write_begin(&dict->iter, dict->buffer, sizeof(dict->buffer));
+  return &dict->iter;
+}
+
+static inline void app_dict_send(app_dict_t *dict)
+{
+  host_receive(dict->buffer, dict_write_end(&dict->iter));
+}
+
+// A new message's header, as the phone sends it before the body
+static inline DictionaryIterator* app_dict_header(app_dict_t *dict, const char *uuid, uint32_t account, bool priority)
+{
+  DictionaryIterator *iter = app_dict_begin(dict);
+  dict_write_cstring(iter, KEY_MSG_UUID, uuid);
+  dict_write_int32(iter, KEY_MSG_TIME, (int32_t)utc_now());
+  dict_write_cstring(iter, KEY_MSG_FROM, "someone@example.com");
+  dict_write_cstring(iter, KEY_MSG_SUBJECT, "Subject");
+  dict_write_uint32(iter, KEY_ACCOUNT_ID, account);
+  if( priority )
+    dict_write_uint8(iter, KEY_MSG_PRIORITY, 1);
+  return iter;
+}
+
+static inline void app_send_header(const char *uuid, uint32_t account, bool priority)
+{
+  app_dict_t dict;
+  app_dict_header(&dict, uuid, account, priority);
+  app_dict_send(&dict);
+}
+
+// A change made on the phone to one message, see apply_sync
+static inline void app_send_sync(uint8_t command, const char *uuid)
+{
+  app_dict_t dict;
+  DictionaryIterator *iter = app_dict_begin(&dict);
+  dict_write_uint8(iter, KEY_SYNC_CMD, command);
+  dict_write_cstring(iter, KEY_MSG_UUID, uuid);
+  app_dict_send(&dict);
+}
+
+// Slot holding the message with uuid, -1 if it is not stored
+static inline int8_t app_find(const char *uuid)
+{
+  for( int8_t i = 0; i < app_metadata.num_messages_filled; i++ )
+  {
+    if( strcmp(uuid_text[app_metadata.order[i]], uuid) == 0 )
+      return app_metadata.order[i];
+  }
+  return -1;
+}
@@ -0,0 +1,516 @@
+// Fuzzes the receive path and the message store: inbound dictionaries,
+// corrupt persisted records, buttons, outbox results, timers and restarts in
+// any order, with the store invariants checked after every step and the
+// persisted store checked to read back what was saved across restarts.
+//
+// The app is built into this file (see enotify_host.h), so the checks can
+// see its state. Built with -fsanitize=fuzzer this is a libFuzzer target;
+// otherwise main() below replays input files or runs seeded random inputs.
+//
+// Input: a launch byte (bit 0 set for a phone launch), then steps of
+// [op][length][length bytes]:
+//   OP_RECEIVE  tuples of [key][type][length][bytes], sent as one dictionary
+//   OP_PERSIST  [record][bytes], overwrites a persisted record now and again
+//               after the app's own writes on exit, as a torn write would
+//   OP_ADVANCE  [n], runs the clock n*20 ms forward, or (n-128) s from 128
+//   OP_CLICK    [button | long 0x4 | repeats << 3]
+//   OP_OUTBOX   [n], completes the pending outbox message, sent if n is 0
+//   OP_RESTART  exits and launches the app again
+//   OP_RENDER   draws the dirty layers
+//   OP_BEGIN    [n], makes outbox_begin fail with a reason unless n is 0
+#include "enotify_host.h"
+
+enum FuzzOps {
+  OP_RECEIVE,
+  OP_PERSIST,
+  OP_ADVANCE,
+  OP_CLICK,
+  OP_OUTBOX,
+  OP_RESTART,
+  OP_RENDER,
+  OP_BEGIN,
+  NUM_OPS
+};
+
+#define MAX_DICT 256
+
+static const AppMessageResult results[] = {
+  APP_MSG_OK, APP_MSG_SEND_TIMEOUT, APP_MSG_SEND_REJECTED, APP_MSG_NOT_CONNECTED,
+  APP_MSG_BUSY, APP_MSG_BUFFER_OVERFLOW, APP_MSG_OUT_OF_MEMORY, APP_MSG_INVALID_ARGS,
+};
+#define NUM_RESULTS (sizeof(results)/sizeof(results[0]))
+
+// Records a step can overwrite
+static const uint32_t persist_keys[] = {
+  PERSIST_KEY_METADATA, PERSIST_KEY_VERSION, PERSIST_KEY_METRICS, PERSIST_KEY_ACCOUNTS,
+  PERSIST_KEY_MESSAGE(0), PERSIST_KEY_MESSAGE(0)+1, PERSIST_KEY_MESSAGE(1), PERSIST_KEY_MESSAGE(1)+1,
+  PERSIST_KEY_MESSAGE(2), PERSIST_KEY_MESSAGE(2)+1, PERSIST_KEY_MESSAGE(3), PERSIST_KEY_MESSAGE(3)+1,
+  PERSIST_KEY_MESSAGE(4), PERSIST_KEY_MESSAGE(4)+1,
+};
+#define NUM_PERSIST_KEYS (sizeof(persist_keys)/sizeof(persist_keys[0]))
+
+// What the store held when the app last exited, to compare with what the
+// next launch reads back
+typedef struct saved_store_t
+{
+  bool valid;
+  app_data_t metadata;
+  uint8_t deleted_slots;
+  uint8_t read_slots;
+  uint8_t priority_slots;
+  int32_t header_time[MAX_MESSAGES];
+  uint32_t account_id[MAX_MESSAGES];
+  char uuid_text[MAX_MESSAGES][MAX_TEXT_LENGTH];
+  char from_text[MAX_MESSAGES][MAX_TEXT_LENGTH];
+  char subject_text[MAX_MESSAGES][MAX_TEXT_LENGTH];
+  char scroll_text[MAX_MESSAGES][MAX_TEXT_LENGTH];
+} saved_store_t;
+
+static saved_store_t saved;
+
+// Records written behind the app's back since it was last launched
+#define MAX_CORRUPT 8
+static struct { uint32_t key; size_t size; uint8_t data[256]; } corrupt[MAX_CORRUPT];
+static int num_corrupt;
+
+#define CHECK(cond) do { if( !(cond) ) { fprintf(stderr, "%s:%d: invariant failed: %s\n", __FILE__, __LINE__, #cond); abort(); } } while(0)
+
+static bool terminated(const char *text)
+{
+  return memchr(text, '\0', MAX_TEXT_LENGTH) != NULL;
+}
+
+static bool is_prefix(const char *prefix, const char *text)
+{
+  return strncmp(prefix, text, strlen(prefix)) == 0;
+}
+
+static void check_store()
+{
+  CHECK(app_metadata.num_messages_filled >= 0 && app_metadata.num_messages_filled <= MAX_MESSAGES);
+  CHECK(order_is_valid());
+  CHECK((slots_loaded & ~ALL_SLOTS_LOADED) == 0);
+
+  uint8_t filled = 0;
+  for( int8_t i = 0; i < app_metadata.num_messages_filled; i++ )
+    filled |= SLOT_BIT(app_metadata.order[i]);
+  CHECK(filled_slots == filled);
+  CHECK(((deleted_slots | read_slots | priority_slots | unsaved_slots) & ~ALL_SLOTS_LOADED) == 0);
+
+  CHECK(view_count >= 0 && view_count <= app_metadata.num_messages_filled);
+  uint8_t seen = 0;
+  for( int8_t i = 0; i < view_count; i++ )
+  {
+    int8_t slot = view[i];
+    CHECK(slot >= 0 && slot < MAX_MESSAGES);
+    CHECK(filled_slots & SLOT_BIT(slot));
+    CHECK(!(seen & SLOT_BIT(slot)));
+    seen |= SLOT_BIT(slot);
+  }
+  CHECK(cursor >= 0 && (cursor < view_count || cursor == 0));
+
+  for( int8_t slot = 0; slot < MAX_MESSAGES; slot++ )
+  {
+    CHECK(terminated(uuid_text[slot]));
+    CHECK(terminated(from_text[slot]));
+    CHECK(terminated(subject_text[slot]));
+    CHECK(terminated(scroll_text[slot]));
+    CHECK(terminated(header_text[slot]));
+    CHECK(terminated(footer_text[slot]));
+  }
+  CHECK(terminated(msg_uuid));
+
+  for( int8_t card = 0; card < MAX_MESSAGES; card++ )
+    CHECK(card_offset[card] <= card_offset[card+1]);
+}
+
+static void save_store()
+{
+  saved.valid = num_corrupt == 0 && slots_loaded == ALL_SLOTS_LOADED;
+  saved.metadata = app_metadata;
+  saved.deleted_slots = deleted_slots;
+  saved.read_slots = read_slots;
+  saved.priority_slots = priority_slots;
+  memcpy(saved.header_time, header_time, sizeof(header_time));
+  memcpy(saved.account_id, account_id, sizeof(account_id));
+  memcpy(saved.uuid_text, uuid_text, sizeof(uuid_text));
+  memcpy(saved.from_text, from_text, sizeof(from_text));
+  memcpy(saved.subject_text, subject_text, sizeof(subject_text));
+  memcpy(saved.scroll_text, scroll_text, sizeof(scroll_text));
+}
+
+// Persisting may shorten text to fit a record but must not change it
+static void check_reload()
+{
+  if( !saved.valid || slots_loaded != ALL_SLOTS_LOADED )
+    return;
+
+  CHECK(app_metadata.num_messages_filled == saved.metadata.num_messages_filled);
+  CHECK(memcmp(app_metadata.order, saved.metadata.order, sizeof(app_metadata.order)) == 0);
+  CHECK(app_metadata.utc_offset == saved.metadata.utc_offset);
+  CHECK(app_metadata.generation >= saved.metadata.generation);
+
+  for( int8_t i = 0; i < app_metadata.num_messages_filled; i++ )
+  {
+    int8_t slot = app_metadata.order[i];
+    CHECK(header_time[slot] == saved.header_time[slot]);
+    CHECK(account_id[slot] == saved.account_id[slot]);
+    CHECK((deleted_slots & SLOT_BIT(slot)) == (saved.deleted_slots & SLOT_BIT(slot)));
+    CHECK((read_slots & SLOT_BIT(slot)) == (saved.read_slots & SLOT_BIT(slot)));
+    CHECK((priority_slots & SLOT_BIT(slot)) == (saved.priority_slots & SLOT_BIT(slot)));
+    CHECK(is_prefix(uuid_text[slot], saved.uuid_text[slot]));
+    CHECK(is_prefix(from_text[slot], saved.from_text[slot]));
+    CHECK(is_prefix(subject_text[slot], saved.subject_text[slot]));
+    CHECK(is_prefix(scroll_text[slot], saved.scroll_text[slot]));
+  }
+  saved.valid = false;
+}
+
+static void launch(AppLaunchReason reason)
+{
+  app_launch(reason);
+  check_store();
+}
+
+static void receive(const uint8_t *data, size_t size)
+{
+  uint8_t buffer[MAX_DICT];
+  DictionaryIterator iter;
+  dict_write_begin(&iter, buffer, sizeof(buffer));
+
+  size_t at = 0;
+  while( at + 3 <= size )
+  {
+    uint32_t key = data[at] % 0x18;
+    TupleType type = data[at+1] % 4;
+    uint8_t length = data[at+2];
+    at += 3;
+    if( length > size-at )
+      length = size-at;
+
+    if( type == TUPLE_INT || type == TUPLE_UINT )
+    {
+      uint8_t value[4] = { 0 };
+      memcpy(value, &data[at], length < 4 ? length : 4);
+      uint8_t width = length >= 4 ? 4 : length >= 2 ? 2 : 1;
+      dict_write_int(&iter, key, value, width, type == TUPLE_INT);
+    }
+    else
+    {
+      // Strings go in exactly as given, terminated or not
+      dict_write_data(&iter, key, &data[at], length);
+      ((Tuple*)((uint8_t*)iter.cursor - sizeof(Tuple) - length))->type = type;
+    }
+    at += length;
+  }
+
+  host_receive(buffer, dict_write_end(&iter));
+}
+
+static void step(uint8_t op, const uint8_t *data, size_t size)
+{
+  uint8_t arg = size > 0 ? data[0] : 0;
+
+  switch( op % NUM_OPS )
+  {
+    case OP_RECEIVE:
+    receive(data, size);
+    break;
+
+    case OP_PERSIST:
+    if( size > 0 && num_corrupt < MAX_CORRUPT )
+    {
+      corrupt[num_corrupt].key = persist_keys[arg % NUM_PERSIST_KEYS];
+      corrupt[num_corrupt].size = size-1;
+      memcpy(corrupt[num_corrupt].data, &data[1], size-1);
+      persist_write_data(corrupt[num_corrupt].key, &data[1], size-1);
+      num_corrupt++;
+    }
+    break;
+
+    case OP_ADVANCE:
+    host_advance(arg < 128 ? arg*20 : (arg-128)*1000);
+    break;
+
+    case OP_CLICK:
+    host_click(arg & 0x3, (arg & 0x4) != 0, arg >> 3);
+    break;
+
+    case OP_OUTBOX:
+    host_outbox_complete(results[arg % NUM_RESULTS]);
+    break;
+
+    case OP_RESTART:
+    do_deinit();
+    save_store();
+    for( int i = 0; i < num_corrupt; i++ )
+      persist_write_data(corrupt[i].key, corrupt[i].data, corrupt[i].size);
+    num_corrupt = 0;
+    host_restart();
+    launch(arg & 1 ? APP_LAUNCH_PHONE : APP_LAUNCH_USER);
+    host_advance(DEFERRED_LOAD_MS);
+    check_reload();
+    break;
+
+    case OP_RENDER:
+    host_render();
+    break;
+
+    case OP_BEGIN:
+    host_outbox_begin_result = results[arg % NUM_RESULTS];
+    break;
+  }
+
+  check_store();
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  host_reset();
+  saved.valid = false;
+  num_corrupt = 0;
+
+  // Corrupt records before any other step are there from the start
+  size_t at = 1;
+  while( at + 2 <= size && data[at] % NUM_OPS == OP_PERSIST )
+  {
+    size_t length = data[at+1] < size-at-2 ? data[at+1] : size-at-2;
+    if( length > 0 )
+      persist_write_data(persist_keys[data[at+2] % NUM_PERSIST_KEYS], &data[at+3], length-1);
+    at += 2 + length;
+  }
+  launch(size > 0 && (data[0] & 1) ? APP_LAUNCH_PHONE : APP_LAUNCH_USER);
+
+  while( at + 2 <= size && !host_exited )
+  {
+    uint8_t op = data[at];
+    size_t length = data[at+1];
+    at += 2;
+    if( length > size-at )
+      length = size-at;
+    step(op, &data[at], length);
+    at += length;
+  }
+
+  if( !host_exited )
+  {
+    do_deinit();
+    check_store();
+  }
+  return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+
+// Random inputs for builds without libFuzzer. Steps are mostly well formed
+// so they get past the first checks: messages with UUIDs from a small pool
+// (so duplicates and syncs find them), body chunks, sync commands and
+// settings, mixed with button presses, outbox results, restarts and
+// corrupt records.
+
+#define MAX_INPUT 4096
+
+static size_t put_tuple(uint8_t *out, uint8_t key, TupleType type, const void *data, uint8_t length)
+{
+  out[0] = key;
+  out[1] = type;
+  out[2] = length;
+  memcpy(&out[3], data, length);
+  return 3 + length;
+}
+
+static size_t put_text(uint8_t *out, uint8_t key, int max_length)
+{
+  static const char *words[] = { "Re: ", "Hello", " the ", "meeting", " thanks", "\xc3\xa9t\xc3\xa9", " ", "tomorrow", ".", "Fwd: " };
+  char text[256];
+  int length = 0;
+  int target = rand() % (max_length+1);
+  while( length < target )
+  {
+    const char *word = words[rand() % 10];
+    int n = strlen(word);
+    if( length + n > target )
+      n = target - length;
+    memcpy(&text[length], word, n);
+    length += n;
+  }
+  // Usually terminated, as the phone sends them
+  if( rand() % 8 && length < 255 )
+    text[length++] = '\0';
+  return put_tuple(out, key, rand() % 8 ? TUPLE_CSTRING : TUPLE_BYTE_ARRAY, text, length);
+}
+
+static size_t put_int(uint8_t *out, uint8_t key, int32_t value)
+{
+  uint8_t width = rand() % 3 == 0 ? 1 : 4;
+  return put_tuple(out, key, rand() % 2 ? TUPLE_INT : TUPLE_UINT, &value, width);
+}
+
+static size_t put_uuid(uint8_t *out)
+{
+  char uuid[8];
+  snprintf(uuid, sizeof(uuid), "id-%d", rand() % 8);
+  return put_tuple(out, KEY_MSG_UUID, TUPLE_CSTRING, uuid, strlen(uuid)+1);
+}
+
+static size_t random_message(uint8_t *out)
+{
+  size_t length = 0;
+  switch( rand() % 6 )
+  {
+    case 0:
+    case 1:
+    length += put_uuid(&out[length]);
+    length += put_int(&out[length], KEY_MSG_TIME, 1500000000 - rand() % 100000000);
+    length += put_text(&out[length], KEY_MSG_FROM, 30);
+    length += put_text(&out[length], KEY_MSG_SUBJECT, 40);
+    if( rand() % 2 )
+      length += put_int(&out[length], KEY_ACCOUNT_ID, rand() % 6);
+    if( rand() % 3 == 0 )
+      length += put_int(&out[length], KEY_MSG_PRIORITY, rand() % 2);
+    if( rand() % 3 == 0 )
+      length += put_int(&out[length], KEY_VIBE_PATTERN, rand() % 6);
+    break;
+
+    case 2:
+    length += put_uuid(&out[length]);
+    length += put_text(&out[length], KEY_MSG_TEXT, 80);
+    length += put_int(&out[length], KEY_MSG_ENCODING, rand() % 8);
+    break;
+
+    case 3:
+    if( rand() % 2 )
+      length += put_uuid(&out[length]);
+    else if( rand() % 2 )
+      length += put_int(&out[length], KEY_ACCOUNT_ID, rand() % 6);
+    length += put_int(&out[length], KEY_SYNC_CMD, rand() % 4);
+    break;
+
+    case 4:
+    switch( rand() % 6 )
+    {
+      case 0: length += put_int(&out[length], KEY_UTC_OFFSET, (rand() % 49 - 24) * 1800); break;
+      case 1: length += put_int(&out[length], KEY_ACTION_SUPPORT, rand() % 2); break;
+      case 2: length += put_int(&out[length], KEY_LOW_POWER_THRESHOLD, rand() % 120 - 10); break;
+      case 3: length += put_int(&out[length], KEY_ACCOUNT_RESERVE, rand() % 7 - 1); break;
+      case 4: length += put_int(&out[length], KEY_EVICTION_POLICY, rand() % 4 - 1); break;
+      case 5: length += put_int(&out[length], KEY_DEBUG_CMD, rand() % 6); break;
+    }
+    break;
+
+    default:
+    // Anything at all
+    for( int n = rand() % 40; n > 0; n-- )
+      out[length++] = rand();
+    break;
+  }
+  return length;
+}
+
+static size_t put_step(uint8_t *input, size_t size, uint8_t op, const uint8_t *data, uint8_t length)
+{
+  input[size] = op;
+  input[size+1] = length;
+  memcpy(&input[size+2], data, length);
+  return size + 2 + length;
+}
+
+static size_t random_input(uint8_t *input)
+{
+  size_t size = 0;
+  input[size++] = rand();
+
+  // Sometimes start from a damaged store
+  int damaged = rand() % 4 == 0 ? 1 + rand() % 3 : 0;
+  int steps = damaged + 1 + rand() % 40;
+  for( int n = 0; n < steps && size + 3*(2+255) <= MAX_INPUT; n++ )
+  {
+    uint8_t data[256];
+    uint8_t op = n < damaged ? OP_PERSIST : rand() % 16;
+
+    if( op == OP_PERSIST && (n < damaged || rand() % 2) )
+    {
+      // Corrupt records are rare or the store never gets going
+      uint8_t length = 1 + rand() % 200;
+      for( int i = 0; i < length; i++ )
+        data[i] = rand();
+      size = put_step(input, size, OP_PERSIST, data, length);
+    }
+    else if( op == OP_CLICK )
+    {
+      // Usually select into the action menu, pick an action and have the
+      // phone answer
+      data[0] = rand();
+      if( rand() % 2 )
+        data[0] = BUTTON_ID_SELECT;
+      size = put_step(input, size, OP_CLICK, data, 1);
+      if( rand() % 2 )
+      {
+        data[0] = 1 + rand() % 3;
+        size = put_step(input, size, OP_CLICK, data, 1);
+        data[0] = rand() % 3 ? 0 : rand();
+        size = put_step(input, size, OP_OUTBOX, data, 1);
+      }
+    }
+    else if( op < NUM_OPS && op != OP_RECEIVE && op != OP_PERSIST )
+    {
+      data[0] = rand();
+      size = put_step(input, size, op, data, 1);
+    }
+    else
+    {
+      size_t length = random_message(data);
+      size = put_step(input, size, OP_RECEIVE, data, length > 255 ? 255 : length);
+    }
+  }
+  return size;
+}
+
+static int replay(const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if( file == NULL )
+  {
+    perror(path);
+    return 1;
+  }
+  static uint8_t input[1 << 20];
+  size_t size = fread(input, 1, sizeof(input), file);
+  fclose(file);
+  LLVMFuzzerTestOneInput(input, size);
+  return 0;
+}
+
+// fuzz_receive [cases [seed]] runs random inputs, fuzz_receive file... replays
+int main(int argc, char **argv)
+{
+  if( argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9') )
+  {
+    int failed = 0;
+    for( int i = 1; i < argc; i++ )
+      failed |= replay(argv[i]);
+    return failed;
+  }
+
+  long cases = argc > 1 ? atol(argv[1]) : 20000;
+  unsigned seed = argc > 2 ? (unsigned)atol(argv[2]) : 1;
+  srand(seed);
+
+  static uint8_t input[MAX_INPUT];
+  for( long n = 0; n < cases; n++ )
+  {
+    size_t size = random_input(input);
+    if( getenv("FUZZ_SAVE") )
+    {
+      FILE *file = fopen(getenv("FUZZ_SAVE"), "wb");
+      fwrite(input, 1, size, file);
+      fclose(file);
+    }
+    LLVMFuzzerTestOneInput(input, size);
+  }
+
+  printf("fuzz_receive: %ld cases OK\n", cases);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,421 @@
+#pragma once
+// Host stand-in for the parts of the Pebble SDK the app uses, so the code in
+// src/ builds and runs on the host for the tests in this directory.
+// pebble_host.c implements it: the dictionary format and persist limits
+// follow the watch, the UI only keeps the state the app reads back, and the
+// functions at the end let a test drive timers, buttons and the outbox.
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+//
+// Graphics types
+//
+
+typedef struct { int16_t x, y; } GPoint;
+typedef struct { int16_t w, h; } GSize;
+typedef struct { GPoint origin; GSize size; } GRect;
+#define GPoint(x,y) ((GPoint){(x),(y)})
+#define GSize(w,h) ((GSize){(w),(h)})
+#define GRect(x,y,w,h) ((GRect){{(x),(y)},{(w),(h)}})
+#define GRectZero GRect(0,0,0,0)
+
+typedef enum { GColorClear=-1, GColorBlack=0, GColorWhite=1 } GColor;
+typedef enum { GTextOverflowModeWordWrap, GTextOverflowModeTrailingEllipsis, GTextOverflowModeFill } GTextOverflowMode;
+typedef enum { GTextAlignmentLeft, GTextAlignmentCenter, GTextAlignmentRight } GTextAlignment;
+typedef enum { GCompOpAssign, GCompOpAssignInverted, GCompOpOr, GCompOpAnd, GCompOpClear, GCompOpSet } GCompOp;
+typedef enum { GCornerNone=0, GCornersAll=15 } GCornerMask;
+
+typedef struct GBitmap { GRect bounds; } GBitmap;
+typedef struct GContext GContext;
+typedef void* GFont;
+typedef struct GTextLayoutCache *GTextLayoutCacheRef;
+
+#define FONT_KEY_GOTHIC_14 "GOTHIC_14"
+#define FONT_KEY_GOTHIC_14_BOLD "GOTHIC_14_BOLD"
+#define FONT_KEY_GOTHIC_18_BOLD "GOTHIC_18_BOLD"
+#define FONT_KEY_GOTHIC_24_BOLD "GOTHIC_24_BOLD"
+
+enum {
+  RESOURCE_ID_BUBBLE_BLACK = 1,
+  RESOURCE_ID_DELETED_BLACK,
+  RESOURCE_ID_UP_ARROW_BLACK,
+  RESOURCE_ID_DOWN_ARROW_BLACK,
+  RESOURCE_ID_TRASH_BLACK,
+  RESOURCE_ID_TRASH_WHITE,
+  RESOURCE_ID_REPLY_1_BLACK,
+  RESOURCE_ID_REPLY_2_BLACK,
+  RESOURCE_ID_OPEN_BLACK,
+  RESOURCE_ID_QUESTION_WHITE,
+  RESOURCE_ID_ERROR_ICON_WHITE,
+};
+
+GFont fonts_get_system_font(const char *font_key);
+GBitmap* gbitmap_create_with_resource(uint32_t resource_id);
+void gbitmap_destroy(GBitmap *bitmap);
+
+void graphics_context_set_fill_color(GContext *ctx, GColor color);
+void graphics_context_set_text_color(GContext *ctx, GColor color);
+void graphics_context_set_stroke_color(GContext *ctx, GColor color);
+void graphics_context_set_compositing_mode(GContext *ctx, GCompOp mode);
+void graphics_fill_rect(GContext *ctx, GRect rect, uint16_t corner_radius, GCornerMask corner_mask);
+void graphics_draw_line(GContext *ctx, GPoint p0, GPoint p1);
+void graphics_draw_bitmap_in_rect(GContext *ctx, const GBitmap *bitmap, GRect rect);
+void graphics_draw_text(GContext *ctx, const char *text, const GFont font, const GRect box,
+                        const GTextOverflowMode overflow_mode, const GTextAlignment alignment,
+                        const GTextLayoutCacheRef layout);
+GSize graphics_text_layout_get_content_size(const char *text, const GFont font, const GRect box,
+                                            const GTextOverflowMode overflow_mode, const GTextAlignment alignment);
+
+//
+// Windows and layers
+//
+
+typedef struct Layer Layer;
+typedef struct TextLayer TextLayer;
+typedef struct BitmapLayer BitmapLayer;
+typedef struct ScrollLayer ScrollLayer;
+typedef struct ActionBarLayer ActionBarLayer;
+typedef struct Window Window;
+typedef void (*LayerUpdateProc)(Layer *layer, GContext *ctx);
+
+typedef enum { BUTTON_ID_BACK, BUTTON_ID_UP, BUTTON_ID_SELECT, BUTTON_ID_DOWN, NUM_BUTTONS } ButtonId;
+typedef void* ClickRecognizerRef;
+typedef void (*ClickHandler)(ClickRecognizerRef recognizer, void *context);
+typedef void (*ClickConfigProvider)(void *context);
+
+#define ACTION_BAR_WIDTH 20
+
+Window* window_create(void);
+void window_destroy(Window *window);
+void window_stack_push(Window *window, bool animated);
+Window* window_stack_pop(bool animated);
+void window_stack_pop_all(const bool animated);
+void window_set_background_color(Window *window, GColor color);
+Layer* window_get_root_layer(const Window *window);
+void window_set_click_config_provider(Window *window, ClickConfigProvider provider);
+void window_single_click_subscribe(ButtonId button_id, ClickHandler handler);
+void window_single_repeating_click_subscribe(ButtonId button_id, uint16_t repeat_interval_ms, ClickHandler handler);
+void window_long_click_subscribe(ButtonId button_id, uint16_t delay_ms, ClickHandler down_handler, ClickHandler up_handler);
+void window_multi_click_subscribe(ButtonId button_id, uint8_t min_clicks, uint8_t max_clicks, uint16_t timeout,
+                                  bool last_click_only, ClickHandler handler);
+uint8_t click_number_of_clicks_counted(ClickRecognizerRef recognizer);
+bool click_recognizer_is_repeating(ClickRecognizerRef recognizer);
+ButtonId click_recognizer_get_button_id(ClickRecognizerRef recognizer);
+
+Layer* layer_create(GRect frame);
+Layer* layer_create_with_data(GRect frame, size_t data_size);
+void* layer_get_data(const Layer *layer);
+void layer_destroy(Layer *layer);
+void layer_mark_dirty(Layer *layer);
+void layer_set_update_proc(Layer *layer, LayerUpdateProc update_proc);
+void layer_set_frame(Layer *layer, GRect frame);
+GRect layer_get_frame(const Layer *layer);
+void layer_set_bounds(Layer *layer, GRect bounds);
+GRect layer_get_bounds(const Layer *layer);
+void layer_add_child(Layer *parent, Layer *child);
+void layer_remove_from_parent(Layer *child);
+void layer_set_hidden(Layer *layer, bool hidden);
+bool layer_get_hidden(const Layer *layer);
+void layer_set_clips(Layer *layer, bool clips);
+
+TextLayer* text_layer_create(GRect frame);
+void text_layer_destroy(TextLayer *text_layer);
+Layer* text_layer_get_layer(TextLayer *text_layer);
+void text_layer_set_text(TextLayer *text_layer, const char *text);
+const char* text_layer_get_text(TextLayer *text_layer);
+void text_layer_set_background_color(TextLayer *text_layer, GColor color);
+void text_layer_set_text_color(TextLayer *text_layer, GColor color);
+void text_layer_set_font(TextLayer *text_layer, GFont font);
+void text_layer_set_overflow_mode(TextLayer *text_layer, GTextOverflowMode line_mode);
+void text_layer_set_text_alignment(TextLayer *text_layer, GTextAlignment text_alignment);
+void text_layer_set_size(TextLayer *text_layer, const GSize max_size);
+GSize text_layer_get_content_size(TextLayer *text_layer);
+
+BitmapLayer* bitmap_layer_create(GRect frame);
+void bitmap_layer_destroy(BitmapLayer *bitmap_layer);
+Layer* bitmap_layer_get_layer(const BitmapLayer *bitmap_layer);
+void bitmap_layer_set_bitmap(BitmapLayer *bitmap_layer, const GBitmap *bitmap);
+
+ScrollLayer* scroll_layer_create(GRect frame);
+void scroll_layer_destroy(ScrollLayer *scroll_layer);
+Layer* scroll_layer_get_layer(const ScrollLayer *scroll_layer);
+void scroll_layer_add_child(ScrollLayer *scroll_layer, Layer *child);
+void scroll_layer_set_shadow_hidden(ScrollLayer *scroll_layer, bool hidden);
+void scroll_layer_set_content_offset(ScrollLayer *scroll_layer, GPoint offset, bool animated);
+GPoint scroll_layer_get_content_offset(ScrollLayer *scroll_layer);
+void scroll_layer_set_content_size(ScrollLayer *scroll_layer, GSize size);
+GSize scroll_layer_get_content_size(const ScrollLayer *scroll_layer);
+
+ActionBarLayer* action_bar_layer_create(void);
+void action_bar_layer_destroy(ActionBarLayer *action_bar);
+Layer* action_bar_layer_get_layer(ActionBarLayer *action_bar);
+void action_bar_layer_add_to_window(ActionBarLayer *action_bar, Window *window);
+void action_bar_layer_set_click_config_provider(ActionBarLayer *action_bar, ClickConfigProvider provider);
+void action_bar_layer_set_icon(ActionBarLayer *action_bar, ButtonId button_id, const GBitmap *icon);
+void action_bar_layer_clear_icon(ActionBarLayer *action_bar, ButtonId button_id);
+
+//
+// Animations
+//
+
+typedef struct Animation Animation;
+typedef struct PropertyAnimation {
+  Animation *animation;
+  struct {
+    union { GRect grect; GPoint gpoint; int16_t int16; } to;
+    union { GRect grect; GPoint gpoint; int16_t int16; } from;
+  } values;
+  void *subject;
+} PropertyAnimation;
+typedef enum { AnimationCurveLinear, AnimationCurveEaseIn, AnimationCurveEaseOut, AnimationCurveEaseInOut } AnimationCurve;
+typedef void (*AnimationStartedHandler)(Animation *animation, void *context);
+typedef void (*AnimationStoppedHandler)(Animation *animation, bool finished, void *context);
+typedef struct { AnimationStartedHandler started; AnimationStoppedHandler stopped; } AnimationHandlers;
+
+PropertyAnimation* property_animation_create_layer_frame(Layer *layer, GRect *from_frame, GRect *to_frame);
+void property_animation_destroy(PropertyAnimation *property_animation);
+void animation_set_duration(Animation *animation, uint32_t duration_ms);
+void animation_set_curve(Animation *animation, AnimationCurve curve);
+void animation_set_delay(Animation *animation, uint32_t delay_ms);
+void animation_set_handlers(Animation *animation, AnimationHandlers callbacks, void *context);
+void animation_schedule(Animation *animation);
+void animation_unschedule(Animation *animation);
+bool animation_is_scheduled(Animation *animation);
+
+//
+// Logging
+//
+
+typedef enum {
+  APP_LOG_LEVEL_ERROR = 1,
+  APP_LOG_LEVEL_WARNING = 50,
+  APP_LOG_LEVEL_INFO = 100,
+  APP_LOG_LEVEL_DEBUG = 200,
+  APP_LOG_LEVEL_DEBUG_VERBOSE = 255,
+} AppLogLevel;
+
+void app_log(uint8_t log_level, const char *src_filename, int src_line_number, const char *fmt, ...)
+  __attribute__((format(printf, 4, 5)));
+#define APP_LOG(level, fmt, args...) app_log(level, __FILE__, __LINE__, fmt, ## args)
+
+//
+// Dictionaries and AppMessage
+//
+
+typedef enum {
+  APP_MSG_OK = 0,
+  APP_MSG_SEND_TIMEOUT = 1 << 1,
+  APP_MSG_SEND_REJECTED = 1 << 2,
+  APP_MSG_NOT_CONNECTED = 1 << 3,
+  APP_MSG_APP_NOT_RUNNING = 1 << 4,
+  APP_MSG_INVALID_ARGS = 1 << 5,
+  APP_MSG_BUSY = 1 << 6,
+  APP_MSG_BUFFER_OVERFLOW = 1 << 7,
+  APP_MSG_ALREADY_RELEASED = 1 << 9,
+  APP_MSG_CALLBACK_ALREADY_REGISTERED = 1 << 10,
+  APP_MSG_CALLBACK_NOT_REGISTERED = 1 << 11,
+  APP_MSG_OUT_OF_MEMORY = 1 << 12,
+  APP_MSG_CLOSED = 1 << 13,
+  APP_MSG_INTERNAL_ERROR = 1 << 14,
+} AppMessageResult;
+
+typedef enum { TUPLE_BYTE_ARRAY = 0, TUPLE_CSTRING = 1, TUPLE_UINT = 2, TUPLE_INT = 3 } TupleType;
+
+typedef union {
+  uint8_t data[0];
+  char cstring[0];
+  uint8_t uint8;
+  uint16_t uint16;
+  uint32_t uint32;
+  int8_t int8;
+  int16_t int16;
+  int32_t int32;
+} __attribute__((__packed__)) TupleValue;
+
+// Wire layout of a dictionary entry, as on the watch
+typedef struct __attribute__((__packed__)) {
+  uint32_t key;
+  TupleType type:8;
+  uint16_t length;
+  TupleValue value[];
+} Tuple;
+
+typedef struct {
+  void *dictionary;
+  const void *end;
+  Tuple *cursor;
+} DictionaryIterator;
+
+typedef enum {
+  DICT_OK = 0,
+  DICT_NOT_ENOUGH_STORAGE = 1 << 1,
+  DICT_INVALID_ARGS = 1 << 2,
+  DICT_INTERNAL_INCONSISTENCY = 1 << 3,
+  DICT_MALLOC_FAILED = 1 << 4,
+} DictionaryResult;
+
+typedef struct {
+  TupleType type;
+  uint32_t key;
+  union {
+    struct { const uint8_t *data; uint16_t length; } bytes;
+    struct { const char *data; uint16_t length; } cstring;
+    struct { uint32_t storage; uint16_t width; } integer;
+  };
+} Tuplet;
+
+#define TupletBytes(_key, _data, _length) \
+  ((const Tuplet) { .type = TUPLE_BYTE_ARRAY, .key = _key, .bytes = { .data = _data, .length = _length }})
+#define TupletCString(_key, _cstring) \
+  ((const Tuplet) { .type = TUPLE_CSTRING, .key = _key, .cstring = { .data = _cstring, .length = _cstring ? strlen(_cstring) + 1 : 0 }})
+#define TupletInteger(_key, _integer) \
+  ((const Tuplet) { .type = TUPLE_INT, .key = _key, .integer = { .storage = _integer, .width = sizeof(_integer) }})
+
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...);
+DictionaryResult dict_write_begin(DictionaryIterator *iter, uint8_t *buffer, const uint16_t size);
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key, const uint8_t *data, const uint16_t size);
+DictionaryResult dict_write_cstring(DictionaryIterator *iter, const uint32_t key, const char *cstring);
+DictionaryResult dict_write_int(DictionaryIterator *iter, const uint32_t key, const void *integer, const uint8_t width_bytes,
+                                const bool is_signed);
+DictionaryResult dict_write_uint8(DictionaryIterator *iter, const uint32_t key, const uint8_t value);
+DictionaryResult dict_write_uint16(DictionaryIterator *iter, const uint32_t key, const uint16_t value);
+DictionaryResult dict_write_uint32(DictionaryIterator *iter, const uint32_t key, const uint32_t value);
+DictionaryResult dict_write_int8(DictionaryIterator *iter, const uint32_t key, const int8_t value);
+DictionaryResult dict_write_int16(DictionaryIterator *iter, const uint32_t key, const int16_t value);
+DictionaryResult dict_write_int32(DictionaryIterator *iter, const uint32_t key, const int32_t value);
+DictionaryResult dict_write_tuplet(DictionaryIterator *iter, const Tuplet * const tuplet);
+uint32_t dict_write_end(DictionaryIterator *iter);
+Tuple* dict_read_begin_from_buffer(DictionaryIterator *iter, const uint8_t * const buffer, const uint16_t size);
+Tuple* dict_read_first(DictionaryIterator *iter);
+Tuple* dict_read_next(DictionaryIterator *iter);
+Tuple* dict_find(const DictionaryIterator *iter, const uint32_t key);
+
+typedef void (*AppMessageInboxReceived)(DictionaryIterator *iterator, void *context);
+typedef void (*AppMessageInboxDropped)(AppMessageResult reason, void *context);
+typedef void (*AppMessageOutboxSent)(DictionaryIterator *iterator, void *context);
+typedef void (*AppMessageOutboxFailed)(DictionaryIterator *iterator, AppMessageResult reason, void *context);
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound);
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived received_callback);
+AppMessageInboxDropped app_message_register_inbox_dropped(AppMessageInboxDropped dropped_callback);
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent sent_callback);
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback);
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator);
+AppMessageResult app_message_outbox_send(void);
+uint32_t app_message_inbox_size_maximum(void);
+uint32_t app_message_outbox_size_maximum(void);
+
+//
+// Storage
+//
+
+#define PERSIST_DATA_MAX_LENGTH 256
+#define E_DOES_NOT_EXIST -4
+
+bool persist_exists(const uint32_t key);
+int persist_get_size(const uint32_t key);
+int persist_read_data(const uint32_t key, void *buffer, const size_t buffer_size);
+int persist_write_data(const uint32_t key, const void *data, const size_t size);
+int32_t persist_read_int(const uint32_t key);
+int persist_write_int(const uint32_t key, const int32_t value);
+bool persist_read_bool(const uint32_t key);
+int persist_write_bool(const uint32_t key, const bool value);
+int persist_delete(const uint32_t key);
+
+//
+// Timers, time and system services
+//
+
+typedef struct AppTimer AppTimer;
+typedef void (*AppTimerCallback)(void *data);
+
+AppTimer* app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data);
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms);
+void app_timer_cancel(AppTimer *timer_handle);
+
+// The watch clock is the host clock of pebble_host.c
+time_t host_time(time_t *tloc);
+#define time(tloc) host_time(tloc)
+uint16_t time_ms(time_t *tloc, uint16_t *out_ms);
+
+typedef struct { const uint32_t *durations; uint32_t num_segments; } VibePattern;
+void vibes_short_pulse(void);
+void vibes_long_pulse(void);
+void vibes_double_pulse(void);
+void vibes_cancel(void);
+void vibes_enqueue_custom_pattern(VibePattern pattern);
+void light_enable_interaction(void);
+void light_enable(bool enable);
+
+typedef struct { uint8_t charge_percent; bool is_charging; bool is_plugged; } BatteryChargeState;
+typedef void (*BatteryStateHandler)(BatteryChargeState charge);
+BatteryChargeState battery_state_service_peek(void);
+void battery_state_service_subscribe(BatteryStateHandler handler);
+void battery_state_service_unsubscribe(void);
+void accel_tap_service_unsubscribe(void);
+void tick_timer_service_unsubscribe(void);
+
+size_t heap_bytes_used(void);
+size_t heap_bytes_free(void);
+
+typedef enum { APP_LAUNCH_SYSTEM, APP_LAUNCH_USER, APP_LAUNCH_PHONE, APP_LAUNCH_WAKEUP, APP_LAUNCH_WORKER } AppLaunchReason;
+AppLaunchReason launch_reason(void);
+
+void app_event_loop(void);
+
+//
+// Host controls, not part of the SDK
+//
+
+// Drops all persisted data, timers, UI objects and handlers and restarts the
+// clocks. Call between runs of the app.
+void host_reset(void);
+// Like host_reset but keeps persisted data and the time, as when the app
+// exits and is launched again
+void host_restart(void);
+
+// Wall clock seconds returned by time(), excluding elapsed host_advance time
+extern time_t host_clock;
+// What launch_reason() returns
+extern AppLaunchReason host_launch_reason;
+// Result of the next app_message_outbox_begin calls, APP_MSG_OK normally
+extern AppMessageResult host_outbox_begin_result;
+// Set by window_stack_pop_all
+extern bool host_exited;
+// Prints app_log output when set; it is formatted either way
+extern bool host_log;
+// Work done through the SDK since the last restart. Tests take the
+// difference across a step to bound what it costs.
+typedef struct host_counters_t {
+  uint32_t icon_sets;
+  uint32_t layers_dirtied;
+  uint32_t layers_drawn;
+  uint32_t sends;
+  uint32_t persist_writes;
+  uint32_t persist_bytes;
+  uint32_t vibes;
+} host_counters_t;
+extern host_counters_t host_counters;
+// Segments of the last custom vibe pattern played
+extern uint32_t host_vibe_segments;
+
+// Moves the clock forward, firing timers as they fall due
+void host_advance(uint32_t ms);
+// Delivers a dictionary to the inbox handler
+void host_receive(const uint8_t *buffer, uint16_t size);
+// Completes the message in the outbox, if any, as sent or failed with reason
+bool host_outbox_pending(void);
+void host_outbox_complete(AppMessageResult reason);
+// The last dictionary the app sent or tried to send
+DictionaryIterator* host_outbox(void);
+// Presses a button through the subscribed click handlers
+void host_click(ButtonId button, bool long_press, uint8_t repeats);
+// Runs the update procs of layers marked dirty
+void host_render(void);
+// Layers alive, windows included: what the firmware walks on each redraw
+size_t host_layer_count(void);
@@ -0,0 +1,986 @@
+#include <pebble.h>
+#include <stdarg.h>
+#include <assert.h>
+
+// Host implementation of pebble.h. Everything lives in fixed tables that
+// host_reset clears, so one process can run the app many times over.
+
+#define MAX_OBJECTS 256
+#define MAX_TIMERS 32
+#define MAX_PERSIST_KEYS 128
+#define MAX_APP_LOG 512
+#define LINE_HEIGHT 18
+#define CHAR_WIDTH 7
+
+time_t host_clock = 1500000000;
+AppLaunchReason host_launch_reason = APP_LAUNCH_USER;
+AppMessageResult host_outbox_begin_result = APP_MSG_OK;
+bool host_exited;
+bool host_log;
+host_counters_t host_counters;
+uint32_t host_vibe_segments;
+
+static uint32_t now_ms;
+
+//
+// Objects
+//
+
+struct Layer {
+  GRect frame;
+  GRect bounds;
+  bool hidden;
+  bool dirty;
+  LayerUpdateProc update_proc;
+  void *data;
+};
+
+struct TextLayer { Layer layer; const char *text; GFont font; };
+struct BitmapLayer { Layer layer; const GBitmap *bitmap; };
+struct ScrollLayer { Layer layer; GPoint offset; GSize content_size; };
+struct ActionBarLayer { Layer layer; const GBitmap *icons[NUM_BUTTONS]; };
+struct Window { Layer root; };
+
+typedef struct host_animation_t {
+  PropertyAnimation property;
+  Layer *layer;
+  bool scheduled;
+  AnimationHandlers handlers;
+  void *context;
+} host_animation_t;
+
+// Every allocation the app can see, with its size for heap_bytes_used, so
+// host_reset can free what it leaked and host_render can find the layers
+typedef enum { OBJECT_FREE, OBJECT_LAYER, OBJECT_ANIMATION, OBJECT_OTHER } object_kind_t;
+static struct { object_kind_t kind; void *pointer; size_t size; } objects[MAX_OBJECTS];
+
+static void* object_create(size_t size, object_kind_t kind)
+{
+  for( int i = 0; i < MAX_OBJECTS; i++ )
+  {
+    if( objects[i].kind == OBJECT_FREE )
+    {
+      objects[i].kind = kind;
+      objects[i].pointer = calloc(1, size);
+      objects[i].size = size;
+      return objects[i].pointer;
+    }
+  }
+  assert(!"out of host objects");
+  return NULL;
+}
+
+static int object_find(const void *pointer)
+{
+  for( int i = 0; i < MAX_OBJECTS; i++ )
+  {
+    if( objects[i].kind != OBJECT_FREE && objects[i].pointer == pointer )
+      return i;
+  }
+  assert(!"unknown object");
+  return -1;
+}
+
+static void object_destroy(void *pointer)
+{
+  if( pointer == NULL )
+    return;
+  objects[object_find(pointer)].kind = OBJECT_FREE;
+  free(pointer);
+}
+
+static void layer_init(Layer *layer, GRect frame)
+{
+  layer->frame = frame;
+  layer->bounds = GRect(0, 0, frame.size.w, frame.size.h);
+}
+
+Layer* layer_create(GRect frame)
+{
+  Layer *layer = object_create(sizeof(Layer), OBJECT_LAYER);
+  layer_init(layer, frame);
+  return layer;
+}
+
+Layer* layer_create_with_data(GRect frame, size_t data_size)
+{
+  Layer *layer = layer_create(frame);
+  layer->data = calloc(1, data_size);
+  objects[object_find(layer)].size += data_size;
+  return layer;
+}
+
+void* layer_get_data(const Layer *layer) { return layer->data; }
+
+void layer_destroy(Layer *layer)
+{
+  if( layer == NULL )
+    return;
+  free(layer->data);
+  object_destroy(layer);
+}
+
+void layer_mark_dirty(Layer *layer)
+{
+  layer->dirty = true;
+  host_counters.layers_dirtied++;
+}
+
+void layer_set_update_proc(Layer *layer, LayerUpdateProc update_proc) { layer->update_proc = update_proc; }
+void layer_set_frame(Layer *layer, GRect frame)
+{
+  layer->frame = frame;
+  layer->bounds.size = frame.size;
+}
+GRect layer_get_frame(const Layer *layer) { return layer->frame; }
+void layer_set_bounds(Layer *layer, GRect bounds) { layer->bounds = bounds; }
+GRect layer_get_bounds(const Layer *layer) { return layer->bounds; }
+void layer_add_child(Layer *parent, Layer *child) { assert(parent && child); }
+void layer_remove_from_parent(Layer *child) { }
+void layer_set_hidden(Layer *layer, bool hidden) { layer->hidden = hidden; }
+bool layer_get_hidden(const Layer *layer) { return layer->hidden; }
+void layer_set_clips(Layer *layer, bool clips) { }
+
+TextLayer* text_layer_create(GRect frame)
+{
+  TextLayer *text_layer = object_create(sizeof(TextLayer), OBJECT_LAYER);
+  layer_init(&text_layer->layer, frame);
+  return text_layer;
+}
+void text_layer_destroy(TextLayer *text_layer) { object_destroy(text_layer); }
+Layer* text_layer_get_layer(TextLayer *text_layer) { return &text_layer->layer; }
+void text_layer_set_text(TextLayer *text_layer, const char *text)
+{
+  // The watch keeps the pointer and reads it on every redraw
+  text_layer->text = text;
+  layer_mark_dirty(&text_layer->layer);
+}
+const char* text_layer_get_text(TextLayer *text_layer) { return text_layer->text; }
+void text_layer_set_background_color(TextLayer *text_layer, GColor color) { }
+void text_layer_set_text_color(TextLayer *text_layer, GColor color) { }
+void text_layer_set_font(TextLayer *text_layer, GFont font) { text_layer->font = font; }
+void text_layer_set_overflow_mode(TextLayer *text_layer, GTextOverflowMode line_mode) { }
+void text_layer_set_text_alignment(TextLayer *text_layer, GTextAlignment text_alignment) { }
+void text_layer_set_size(TextLayer *text_layer, const GSize max_size) { text_layer->layer.frame.size = max_size; }
+GSize text_layer_get_content_size(TextLayer *text_layer)
+{
+  return graphics_text_layout_get_content_size(text_layer->text ? text_layer->text : "", text_layer->font,
+                                               text_layer->layer.bounds, GTextOverflowModeWordWrap, GTextAlignmentLeft);
+}
+
+BitmapLayer* bitmap_layer_create(GRect frame)
+{
+  BitmapLayer *bitmap_layer = object_create(sizeof(BitmapLayer), OBJECT_LAYER);
+  layer_init(&bitmap_layer->layer, frame);
+  return bitmap_layer;
+}
+void bitmap_layer_destroy(BitmapLayer *bitmap_layer) { object_destroy(bitmap_layer); }
+Layer* bitmap_layer_get_layer(const BitmapLayer *bitmap_layer) { return (Layer*)&bitmap_layer->layer; }
+void bitmap_layer_set_bitmap(BitmapLayer *bitmap_layer, const GBitmap *bitmap) { bitmap_layer->bitmap = bitmap; }
+
+ScrollLayer* scroll_layer_create(GRect frame)
+{
+  ScrollLayer *scroll_layer = object_create(sizeof(ScrollLayer), OBJECT_LAYER);
+  layer_init(&scroll_layer->layer, frame);
+  scroll_layer->content_size = frame.size;
+  return scroll_layer;
+}
+void scroll_layer_destroy(ScrollLayer *scroll_layer) { object_destroy(scroll_layer); }
+Layer* scroll_layer_get_layer(const ScrollLayer *scroll_layer) { return (Layer*)&scroll_layer->layer; }
+void scroll_layer_add_child(ScrollLayer *scroll_layer, Layer *child) { assert(child); }
+void scroll_layer_set_shadow_hidden(ScrollLayer *scroll_layer, bool hidden) { }
+void scroll_layer_set_content_offset(ScrollLayer *scroll_layer, GPoint offset, bool animated) { scroll_layer->offset = offset; }
+GPoint scroll_layer_get_content_offset(ScrollLayer *scroll_layer) { return scroll_layer->offset; }
+void scroll_layer_set_content_size(ScrollLayer *scroll_layer, GSize size) { scroll_layer->content_size = size; }
+GSize scroll_layer_get_content_size(const ScrollLayer *scroll_layer) { return scroll_layer->content_size; }
+
+ActionBarLayer* action_bar_layer_create(void)
+{
+  ActionBarLayer *action_bar = object_create(sizeof(ActionBarLayer), OBJECT_LAYER);
+  layer_init(&action_bar->layer, GRect(0, 0, ACTION_BAR_WIDTH, 168));
+  return action_bar;
+}
+void action_bar_layer_destroy(ActionBarLayer *action_bar) { object_destroy(action_bar); }
+Layer* action_bar_layer_get_layer(ActionBarLayer *action_bar) { return &action_bar->layer; }
+void action_bar_layer_add_to_window(ActionBarLayer *action_bar, Window *window)
+{
+  GRect bounds = window->root.bounds;
+  layer_set_frame(&action_bar->layer, GRect(bounds.size.w - ACTION_BAR_WIDTH, 0, ACTION_BAR_WIDTH, bounds.size.h));
+}
+void action_bar_layer_set_icon(ActionBarLayer *action_bar, ButtonId button_id, const GBitmap *icon)
+{
+  action_bar->icons[button_id] = icon;
+  host_counters.icon_sets++;
+}
+
+void action_bar_layer_clear_icon(ActionBarLayer *action_bar, ButtonId button_id)
+{
+  action_bar->icons[button_id] = NULL;
+  host_counters.icon_sets++;
+}
+
+GBitmap* gbitmap_create_with_resource(uint32_t resource_id)
+{
+  GBitmap *bitmap = object_create(sizeof(GBitmap), OBJECT_OTHER);
+  bitmap->bounds = GRect(0, 0, 16, 16);
+  return bitmap;
+}
+void gbitmap_destroy(GBitmap *bitmap) { object_destroy(bitmap); }
+
+GFont fonts_get_system_font(const char *font_key) { return (GFont)font_key; }
+
+//
+// Drawing. Text is measured as fixed width characters wrapped at the box
+// width, which is enough for the layout code to have real heights to work with.
+//
+
+void graphics_context_set_fill_color(GContext *ctx, GColor color) { }
+void graphics_context_set_text_color(GContext *ctx, GColor color) { }
+void graphics_context_set_stroke_color(GContext *ctx, GColor color) { }
+void graphics_context_set_compositing_mode(GContext *ctx, GCompOp mode) { }
+void graphics_fill_rect(GContext *ctx, GRect rect, uint16_t corner_radius, GCornerMask corner_mask) { }
+void graphics_draw_line(GContext *ctx, GPoint p0, GPoint p1) { }
+void graphics_draw_bitmap_in_rect(GContext *ctx, const GBitmap *bitmap, GRect rect) { assert(bitmap); }
+
+GSize graphics_text_layout_get_content_size(const char *text, const GFont font, const GRect box,
+                                            const GTextOverflowMode overflow_mode, const GTextAlignment alignment)
+{
+  int per_line = box.size.w / CHAR_WIDTH;
+  if( per_line < 1 )
+    per_line = 1;
+  int lines = strlen(text) / per_line + 1;
+  int height = lines * LINE_HEIGHT;
+  if( overflow_mode != GTextOverflowModeWordWrap && height > box.size.h )
+    height = box.size.h;
+  return GSize(box.size.w, height);
+}
+
+void graphics_draw_text(GContext *ctx, const char *text, const GFont font, const GRect box,
+                        const GTextOverflowMode overflow_mode, const GTextAlignment alignment,
+                        const GTextLayoutCacheRef layout)
+{
+  graphics_text_layout_get_content_size(text, font, box, overflow_mode, alignment);
+}
+
+void host_render(void)
+{
+  for( int i = 0; i < MAX_OBJECTS; i++ )
+  {
+    if( objects[i].kind != OBJECT_LAYER )
+      continue;
+    Layer *layer = objects[i].pointer;
+    // Text, bitmap and other system layers draw themselves
+    if( layer->dirty )
+      host_counters.layers_drawn++;
+    if( layer->dirty && layer->update_proc )
+      layer->update_proc(layer, NULL);
+    layer->dirty = false;
+  }
+}
+
+//
+// Windows and clicks
+//
+
+static ClickConfigProvider click_config_provider;
+static void *click_config_context;
+static ClickHandler single_handlers[NUM_BUTTONS];
+static uint16_t repeat_intervals[NUM_BUTTONS];
+static ClickHandler long_down_handlers[NUM_BUTTONS];
+static ClickHandler long_up_handlers[NUM_BUTTONS];
+
+typedef struct host_click_t {
+  ButtonId button;
+  uint8_t clicks;
+  bool repeating;
+} host_click_t;
+
+Window* window_create(void)
+{
+  Window *window = object_create(sizeof(Window), OBJECT_LAYER);
+  layer_init(&window->root, GRect(0, 0, 144, 168));
+  return window;
+}
+void window_destroy(Window *window) { object_destroy(window); }
+void window_stack_push(Window *window, bool animated) { }
+Window* window_stack_pop(bool animated) { host_exited = true; return NULL; }
+void window_stack_pop_all(const bool animated) { host_exited = true; }
+void window_set_background_color(Window *window, GColor color) { }
+Layer* window_get_root_layer(const Window *window) { return (Layer*)&window->root; }
+
+void window_set_click_config_provider(Window *window, ClickConfigProvider provider)
+{
+  click_config_provider = provider;
+  click_config_context = window;
+}
+
+void action_bar_layer_set_click_config_provider(ActionBarLayer *action_bar, ClickConfigProvider provider)
+{
+  click_config_provider = provider;
+  click_config_context = action_bar;
+}
+
+void window_single_click_subscribe(ButtonId button_id, ClickHandler handler)
+{
+  single_handlers[button_id] = handler;
+  repeat_intervals[button_id] = 0;
+}
+
+void window_single_repeating_click_subscribe(ButtonId button_id, uint16_t repeat_interval_ms, ClickHandler handler)
+{
+  single_handlers[button_id] = handler;
+  repeat_intervals[button_id] = repeat_interval_ms;
+}
+
+void window_long_click_subscribe(ButtonId button_id, uint16_t delay_ms, ClickHandler down_handler, ClickHandler up_handler)
+{
+  long_down_handlers[button_id] = down_handler;
+  long_up_handlers[button_id] = up_handler;
+}
+
+void window_multi_click_subscribe(ButtonId button_id, uint8_t min_clicks, uint8_t max_clicks, uint16_t timeout,
+                                  bool last_click_only, ClickHandler handler) { }
+
+uint8_t click_number_of_clicks_counted(ClickRecognizerRef recognizer) { return ((host_click_t*)recognizer)->clicks; }
+bool click_recognizer_is_repeating(ClickRecognizerRef recognizer) { return ((host_click_t*)recognizer)->repeating; }
+ButtonId click_recognizer_get_button_id(ClickRecognizerRef recognizer) { return ((host_click_t*)recognizer)->button; }
+
+void host_click(ButtonId button, bool long_press, uint8_t repeats)
+{
+  if( button >= NUM_BUTTONS )
+    return;
+
+  memset(single_handlers, 0, sizeof(single_handlers));
+  memset(repeat_intervals, 0, sizeof(repeat_intervals));
+  memset(long_down_handlers, 0, sizeof(long_down_handlers));
+  memset(long_up_handlers, 0, sizeof(long_up_handlers));
+  if( click_config_provider )
+    click_config_provider(click_config_context);
+
+  host_click_t click = { button, 1, false };
+  if( long_press && long_down_handlers[button] )
+  {
+    long_down_handlers[button](&click, click_config_context);
+    if( long_up_handlers[button] )
+      long_up_handlers[button](&click, click_config_context);
+    return;
+  }
+
+  if( single_handlers[button] == NULL )
+  {
+    // Back without a handler leaves the app
+    if( button == BUTTON_ID_BACK )
+      host_exited = true;
+    return;
+  }
+
+  single_handlers[button](&click, click_config_context);
+  for( uint8_t i = 0; i < repeats && repeat_intervals[button] > 0; i++ )
+  {
+    click.clicks++;
+    click.repeating = true;
+    single_handlers[button](&click, click_config_context);
+  }
+}
+
+//
+// Animations run to completion on the next host_advance
+//
+
+PropertyAnimation* property_animation_create_layer_frame(Layer *layer, GRect *from_frame, GRect *to_frame)
+{
+  host_animation_t *animation = object_create(sizeof(host_animation_t), OBJECT_ANIMATION);
+  animation->property.animation = (Animation*)animation;
+  animation->property.subject = layer;
+  animation->layer = layer;
+  animation->property.values.from.grect = from_frame ? *from_frame : layer->frame;
+  animation->property.values.to.grect = to_frame ? *to_frame : layer->frame;
+  return &animation->property;
+}
+
+void property_animation_destroy(PropertyAnimation *property_animation) { object_destroy(property_animation); }
+void animation_set_duration(Animation *animation, uint32_t duration_ms) { }
+void animation_set_curve(Animation *animation, AnimationCurve curve) { }
+void animation_set_delay(Animation *animation, uint32_t delay_ms) { }
+
+void animation_set_handlers(Animation *animation, AnimationHandlers callbacks, void *context)
+{
+  ((host_animation_t*)animation)->handlers = callbacks;
+  ((host_animation_t*)animation)->context = context;
+}
+
+void animation_schedule(Animation *animation)
+{
+  host_animation_t *host = (host_animation_t*)animation;
+  host->scheduled = true;
+  if( host->handlers.started )
+    host->handlers.started(animation, host->context);
+}
+
+void animation_unschedule(Animation *animation)
+{
+  host_animation_t *host = (host_animation_t*)animation;
+  if( !host->scheduled )
+    return;
+  host->scheduled = false;
+  if( host->handlers.stopped )
+    host->handlers.stopped(animation, false, host->context);
+}
+
+bool animation_is_scheduled(Animation *animation) { return ((host_animation_t*)animation)->scheduled; }
+
+static void finish_animations(void)
+{
+  for( int i = 0; i < MAX_OBJECTS; i++ )
+  {
+    if( objects[i].kind != OBJECT_ANIMATION )
+      continue;
+    host_animation_t *animation = objects[i].pointer;
+    if( !animation->scheduled )
+      continue;
+    layer_set_frame(animation->layer, animation->property.values.to.grect);
+    animation->scheduled = false;
+    if( animation->handlers.stopped )
+      animation->handlers.stopped((Animation*)animation, true, animation->context);
+  }
+}
+
+//
+// Logging. Messages are always formatted so bad arguments show up under the
+// sanitizers even when nothing is printed.
+//
+
+void app_log(uint8_t log_level, const char *src_filename, int src_line_number, const char *fmt, ...)
+{
+  char message[MAX_APP_LOG];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(message, sizeof(message), fmt, args);
+  va_end(args);
+  if( host_log )
+    printf("[%d] %s:%d %s\n", log_level, src_filename, src_line_number, message);
+}
+
+//
+// Dictionaries: a count byte followed by packed Tuples, as on the watch
+//
+
+static Tuple* tuple_at(const DictionaryIterator *iter, const uint8_t *at)
+{
+  const uint8_t *end = iter->end;
+  if( at + sizeof(Tuple) > end )
+    return NULL;
+  Tuple *tuple = (Tuple*)at;
+  if( at + sizeof(Tuple) + tuple->length > end )
+    return NULL;
+  return tuple;
+}
+
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...)
+{
+  uint32_t size = 1;
+  va_list args;
+  va_start(args, tuple_count);
+  for( uint8_t i = 0; i < tuple_count; i++ )
+    size += sizeof(Tuple) + va_arg(args, uint32_t);
+  va_end(args);
+  return size;
+}
+
+DictionaryResult dict_write_begin(DictionaryIterator *iter, uint8_t *buffer, const uint16_t size)
+{
+  if( iter == NULL || buffer == NULL || size < 1 )
+    return DICT_INVALID_ARGS;
+  iter->dictionary = buffer;
+  iter->end = buffer + size;
+  iter->cursor = (Tuple*)(buffer + 1);
+  buffer[0] = 0;
+  return DICT_OK;
+}
+
+static DictionaryResult write_tuple(DictionaryIterator *iter, uint32_t key, TupleType type, const void *data, uint16_t length)
+{
+  if( iter == NULL || iter->dictionary == NULL || (length > 0 && data == NULL) )
+    return DICT_INVALID_ARGS;
+  uint8_t *at = (uint8_t*)iter->cursor;
+  if( at + sizeof(Tuple) + length > (const uint8_t*)iter->end )
+    return DICT_NOT_ENOUGH_STORAGE;
+
+  Tuple *tuple = (Tuple*)at;
+  tuple->key = key;
+  tuple->type = type;
+  tuple->length = length;
+  if( length > 0 )
+    memcpy(tuple->value->data, data, length);
+  iter->cursor = (Tuple*)(at + sizeof(Tuple) + length);
+  ((uint8_t*)iter->dictionary)[0]++;
+  return DICT_OK;
+}
+
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key, const uint8_t *data, const uint16_t size)
+{
+  return write_tuple(iter, key, TUPLE_BYTE_ARRAY, data, size);
+}
+
+DictionaryResult dict_write_cstring(DictionaryIterator *iter, const uint32_t key, const char *cstring)
+{
+  return write_tuple(iter, key, TUPLE_CSTRING, cstring, cstring ? strlen(cstring) + 1 : 0);
+}
+
+DictionaryResult dict_write_int(DictionaryIterator *iter, const uint32_t key, const void *integer, const uint8_t width_bytes,
+                                const bool is_signed)
+{
+  if( width_bytes != 1 && width_bytes != 2 && width_bytes != 4 )
+    return DICT_INVALID_ARGS;
+  return write_tuple(iter, key, is_signed ? TUPLE_INT : TUPLE_UINT, integer, width_bytes);
+}
+
+DictionaryResult dict_write_uint8(DictionaryIterator *iter, const uint32_t key, const uint8_t value) { return dict_write_int(iter, key, &value, 1, false); }
+DictionaryResult dict_write_uint16(DictionaryIterator *iter, const uint32_t key, const uint16_t value) { return dict_write_int(iter, key, &value, 2, false); }
+DictionaryResult dict_write_uint32(DictionaryIterator *iter, const uint32_t key, const uint32_t value) { return dict_write_int(iter, key, &value, 4, false); }
+DictionaryResult dict_write_int8(DictionaryIterator *iter, const uint32_t key, const int8_t value) { return dict_write_int(iter, key, &value, 1, true); }
+DictionaryResult dict_write_int16(DictionaryIterator *iter, const uint32_t key, const int16_t value) { return dict_write_int(iter, key, &value, 2, true); }
+DictionaryResult dict_write_int32(DictionaryIterator *iter, const uint32_t key, const int32_t value) { return dict_write_int(iter, key, &value, 4, true); }
+
+DictionaryResult dict_write_tuplet(DictionaryIterator *iter, const Tuplet * const tuplet)
+{
+  switch( tuplet->type )
+  {
+    case TUPLE_BYTE_ARRAY:
+    return dict_write_data(iter, tuplet->key, tuplet->bytes.data, tuplet->bytes.length);
+    case TUPLE_CSTRING:
+    return write_tuple(iter, tuplet->key, TUPLE_CSTRING, tuplet->cstring.data, tuplet->cstring.length);
+    case TUPLE_INT:
+    case TUPLE_UINT:
+    return dict_write_int(iter, tuplet->key, &tuplet->integer.storage, tuplet->integer.width, tuplet->type == TUPLE_INT);
+  }
+  return DICT_INVALID_ARGS;
+}
+
+uint32_t dict_write_end(DictionaryIterator *iter)
+{
+  if( iter == NULL || iter->dictionary == NULL )
+    return 0;
+  iter->end = iter->cursor;
+  return (uint8_t*)iter->cursor - (uint8_t*)iter->dictionary;
+}
+
+Tuple* dict_read_first(DictionaryIterator *iter)
+{
+  iter->cursor = tuple_at(iter, (uint8_t*)iter->dictionary + 1);
+  return iter->cursor;
+}
+
+Tuple* dict_read_begin_from_buffer(DictionaryIterator *iter, const uint8_t * const buffer, const uint16_t size)
+{
+  if( iter == NULL || buffer == NULL || size < 1 )
+    return NULL;
+  iter->dictionary = (void*)buffer;
+  iter->end = buffer + size;
+  return dict_read_first(iter);
+}
+
+Tuple* dict_read_next(DictionaryIterator *iter)
+{
+  if( iter->cursor == NULL )
+    return NULL;
+  iter->cursor = tuple_at(iter, (uint8_t*)iter->cursor + sizeof(Tuple) + iter->cursor->length);
+  return iter->cursor;
+}
+
+Tuple* dict_find(const DictionaryIterator *iter, const uint32_t key)
+{
+  DictionaryIterator copy = *iter;
+  for( Tuple *tuple = dict_read_first(&copy); tuple; tuple = dict_read_next(&copy) )
+  {
+    if( tuple->key == key )
+      return tuple;
+  }
+  return NULL;
+}
+
+//
+// AppMessage. A sent message stays in the outbox until host_outbox_complete.
+//
+
+static AppMessageInboxReceived inbox_received;
+static AppMessageInboxDropped inbox_dropped;
+static AppMessageOutboxSent outbox_sent;
+static AppMessageOutboxFailed outbox_failed;
+static uint8_t *outbox_buffer;
+static uint32_t inbox_size;
+static uint32_t outbox_size;
+static DictionaryIterator outbox_iter;
+static enum { OUTBOX_IDLE, OUTBOX_WRITING, OUTBOX_SENDING } outbox_state;
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound)
+{
+  if( outbox_buffer )
+    return APP_MSG_INVALID_ARGS;
+  inbox_size = size_inbound;
+  outbox_size = size_outbound;
+  outbox_buffer = malloc(size_outbound);
+  return APP_MSG_OK;
+}
+
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived callback)
+{
+  AppMessageInboxReceived previous = inbox_received;
+  inbox_received = callback;
+  return previous;
+}
+
+AppMessageInboxDropped app_message_register_inbox_dropped(AppMessageInboxDropped callback)
+{
+  AppMessageInboxDropped previous = inbox_dropped;
+  inbox_dropped = callback;
+  return previous;
+}
+
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent callback)
+{
+  AppMessageOutboxSent previous = outbox_sent;
+  outbox_sent = callback;
+  return previous;
+}
+
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed callback)
+{
+  AppMessageOutboxFailed previous = outbox_failed;
+  outbox_failed = callback;
+  return previous;
+}
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator)
+{
+  if( iterator == NULL || outbox_buffer == NULL )
+    return APP_MSG_INVALID_ARGS;
+  if( host_outbox_begin_result != APP_MSG_OK )
+    return host_outbox_begin_result;
+  if( outbox_state == OUTBOX_SENDING )
+    return APP_MSG_BUSY;
+  dict_write_begin(&outbox_iter, outbox_buffer, outbox_size);
+  outbox_state = OUTBOX_WRITING;
+  *iterator = &outbox_iter;
+  return APP_MSG_OK;
+}
+
+AppMessageResult app_message_outbox_send(void)
+{
+  if( outbox_state == OUTBOX_SENDING )
+    return APP_MSG_BUSY;
+  if( outbox_state != OUTBOX_WRITING )
+    return APP_MSG_INVALID_ARGS;
+  dict_write_end(&outbox_iter);
+  outbox_state = OUTBOX_SENDING;
+  host_counters.sends++;
+  return APP_MSG_OK;
+}
+
+uint32_t app_message_inbox_size_maximum(void) { return 2026; }
+uint32_t app_message_outbox_size_maximum(void) { return 656; }
+
+bool host_outbox_pending(void) { return outbox_state == OUTBOX_SENDING; }
+DictionaryIterator* host_outbox(void) { return outbox_buffer ? &outbox_iter : NULL; }
+
+void host_outbox_complete(AppMessageResult reason)
+{
+  if( outbox_state != OUTBOX_SENDING )
+    return;
+  outbox_state = OUTBOX_IDLE;
+
+  DictionaryIterator sent = outbox_iter;
+  if( reason == APP_MSG_OK )
+  {
+    if( outbox_sent )
+      outbox_sent(&sent, NULL);
+  }
+  else if( outbox_failed )
+    outbox_failed(&sent, reason, NULL);
+}
+
+void host_receive(const uint8_t *buffer, uint16_t size)
+{
+  if( size > inbox_size )
+  {
+    if( inbox_dropped )
+      inbox_dropped(APP_MSG_BUFFER_OVERFLOW, NULL);
+    return;
+  }
+
+  // Received dictionaries live in the inbox buffer, so a copy of the exact
+  // size lets the sanitizers catch reads past the end
+  uint8_t *inbox = malloc(size);
+  memcpy(inbox, buffer, size);
+  DictionaryIterator iter;
+  dict_read_begin_from_buffer(&iter, inbox, size);
+  if( inbox_received )
+    inbox_received(&iter, NULL);
+  free(inbox);
+}
+
+//
+// Storage, with the watch's per key size limit
+//
+
+static struct {
+  bool used;
+  uint32_t key;
+  size_t size;
+  uint8_t data[PERSIST_DATA_MAX_LENGTH];
+} records[MAX_PERSIST_KEYS];
+
+static int find_record(uint32_t key, bool add)
+{
+  int free_record = -1;
+  for( int i = 0; i < MAX_PERSIST_KEYS; i++ )
+  {
+    if( records[i].used && records[i].key == key )
+      return i;
+    if( !records[i].used && free_record < 0 )
+      free_record = i;
+  }
+  if( !add || free_record < 0 )
+    return -1;
+  records[free_record].used = true;
+  records[free_record].key = key;
+  records[free_record].size = 0;
+  return free_record;
+}
+
+bool persist_exists(const uint32_t key) { return find_record(key, false) >= 0; }
+
+int persist_get_size(const uint32_t key)
+{
+  int record = find_record(key, false);
+  return record < 0 ? E_DOES_NOT_EXIST : (int)records[record].size;
+}
+
+int persist_read_data(const uint32_t key, void *buffer, const size_t buffer_size)
+{
+  int record = find_record(key, false);
+  if( record < 0 )
+    return E_DOES_NOT_EXIST;
+  size_t size = records[record].size < buffer_size ? records[record].size : buffer_size;
+  memcpy(buffer, records[record].data, size);
+  return size;
+}
+
+int persist_write_data(const uint32_t key, const void *data, const size_t size)
+{
+  int record = find_record(key, true);
+  assert(record >= 0);
+  size_t written = size < PERSIST_DATA_MAX_LENGTH ? size : PERSIST_DATA_MAX_LENGTH;
+  memcpy(records[record].data, data, written);
+  records[record].size = written;
+  host_counters.persist_writes++;
+  host_counters.persist_bytes += written;
+  return written;
+}
+
+int32_t persist_read_int(const uint32_t key)
+{
+  int32_t value = 0;
+  persist_read_data(key, &value, sizeof(value));
+  return value;
+}
+
+int persist_write_int(const uint32_t key, const int32_t value) { return persist_write_data(key, &value, sizeof(value)); }
+bool persist_read_bool(const uint32_t key) { return persist_read_int(key) != 0; }
+int persist_write_bool(const uint32_t key, const bool value) { return persist_write_int(key, value); }
+
+int persist_delete(const uint32_t key)
+{
+  int record = find_record(key, false);
+  if( record < 0 )
+    return E_DOES_NOT_EXIST;
+  records[record].used = false;
+  return 0;
+}
+
+//
+// Timers and time. Timer handles are ids, so cancelling one that already
+// fired is harmless, as on the watch.
+//
+
+static struct {
+  uint32_t id;
+  uint32_t due;
+  AppTimerCallback callback;
+  void *data;
+} timers[MAX_TIMERS];
+static uint32_t next_timer_id;
+
+AppTimer* app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data)
+{
+  for( int i = 0; i < MAX_TIMERS; i++ )
+  {
+    if( timers[i].id == 0 )
+    {
+      timers[i].id = ++next_timer_id;
+      timers[i].due = now_ms + timeout_ms;
+      timers[i].callback = callback;
+      timers[i].data = callback_data;
+      return (AppTimer*)(uintptr_t)timers[i].id;
+    }
+  }
+  assert(!"out of host timers");
+  return NULL;
+}
+
+static int find_timer(AppTimer *timer_handle)
+{
+  uint32_t id = (uint32_t)(uintptr_t)timer_handle;
+  for( int i = 0; id != 0 && i < MAX_TIMERS; i++ )
+  {
+    if( timers[i].id == id )
+      return i;
+  }
+  return -1;
+}
+
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms)
+{
+  int timer = find_timer(timer_handle);
+  if( timer < 0 )
+    return false;
+  timers[timer].due = now_ms + new_timeout_ms;
+  return true;
+}
+
+void app_timer_cancel(AppTimer *timer_handle)
+{
+  int timer = find_timer(timer_handle);
+  if( timer >= 0 )
+    timers[timer].id = 0;
+}
+
+void host_advance(uint32_t ms)
+{
+  uint32_t target = now_ms + ms;
+  for( ;; )
+  {
+    int next = -1;
+    for( int i = 0; i < MAX_TIMERS; i++ )
+    {
+      if( timers[i].id != 0 && timers[i].due <= target && (next < 0 || timers[i].due < timers[next].due) )
+        next = i;
+    }
+    if( next < 0 )
+      break;
+
+    if( timers[next].due > now_ms )
+      now_ms = timers[next].due;
+    AppTimerCallback callback = timers[next].callback;
+    void *data = timers[next].data;
+    timers[next].id = 0;
+    callback(data);
+  }
+  now_ms = target;
+  finish_animations();
+}
+
+time_t host_time(time_t *tloc)
+{
+  time_t now = host_clock + now_ms/1000;
+  if( tloc )
+    *tloc = now;
+  return now;
+}
+
+uint16_t time_ms(time_t *tloc, uint16_t *out_ms)
+{
+  host_time(tloc);
+  uint16_t ms = now_ms % 1000;
+  if( out_ms )
+    *out_ms = ms;
+  return ms;
+}
+
+//
+// System services
+//
+
+static BatteryStateHandler battery_handler;
+
+void vibes_short_pulse(void) { host_counters.vibes++; }
+void vibes_long_pulse(void) { host_counters.vibes++; }
+void vibes_double_pulse(void) { host_counters.vibes++; }
+void vibes_cancel(void) { }
+
+void vibes_enqueue_custom_pattern(VibePattern pattern)
+{
+  assert(pattern.num_segments == 0 || pattern.durations);
+  host_counters.vibes++;
+  host_vibe_segments = pattern.num_segments;
+}
+void light_enable_interaction(void) { }
+void light_enable(bool enable) { }
+
+BatteryChargeState battery_state_service_peek(void) { return (BatteryChargeState){ 80, false, false }; }
+void battery_state_service_subscribe(BatteryStateHandler handler) { battery_handler = handler; }
+void battery_state_service_unsubscribe(void) { battery_handler = NULL; }
+void accel_tap_service_unsubscribe(void) { }
+void tick_timer_service_unsubscribe(void) { }
+
+// The app's objects and the AppMessage buffers, which the watch also takes
+// from the app heap; not the allocator's own overhead
+size_t heap_bytes_used(void)
+{
+  size_t used = outbox_buffer ? inbox_size + outbox_size : 0;
+  for( int i = 0; i < MAX_OBJECTS; i++ )
+  {
+    if( objects[i].kind != OBJECT_FREE )
+      used += objects[i].size;
+  }
+  return used;
+}
+
+size_t host_layer_count(void)
+{
+  size_t count = 0;
+  for( int i = 0; i < MAX_OBJECTS; i++ )
+  {
+    if( objects[i].kind == OBJECT_LAYER )
+      count++;
+  }
+  return count;
+}
+
+size_t heap_bytes_free(void) { return 24*1024; }
+AppLaunchReason launch_reason(void) { return host_launch_reason; }
+void app_event_loop(void) { }
+
+void host_restart(void)
+{
+  for( int i = 0; i < MAX_OBJECTS; i++ )
+  {
+    if( objects[i].kind == OBJECT_LAYER )
+      free(((Layer*)objects[i].pointer)->data);
+    if( objects[i].kind != OBJECT_FREE )
+      free(objects[i].pointer);
+    objects[i].kind = OBJECT_FREE;
+  }
+  memset(timers, 0, sizeof(timers));
+  free(outbox_buffer);
+  outbox_buffer = NULL;
+  outbox_state = OUTBOX_IDLE;
+  inbox_received = NULL;
+  inbox_dropped = NULL;
+  outbox_sent = NULL;
+  outbox_failed = NULL;
+  click_config_provider = NULL;
+  battery_handler = NULL;
+  host_outbox_begin_result = APP_MSG_OK;
+  host_launch_reason = APP_LAUNCH_USER;
+  host_exited = false;
+  memset(&host_counters, 0, sizeof(host_counters));
+  host_vibe_segments = 0;
+}
+
+void host_reset(void)
+{
+  host_restart();
+  memset(records, 0, sizeof(records));
+  now_ms = 0;
+}
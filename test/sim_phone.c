@@ -0,0 +1,492 @@
+// A stand-in for the phone companion, talking the app's KEY_* protocol to the
+// host build of enotify.c over a simulated AppMessage link, in virtual time.
+//
+// The phone sends mail at random intervals, a header and body chunks each a
+// link latency apart. It answers the launch hello with the UTC offset and
+// action support, and acks or fails each message the watch sends: busy,
+// rejected or timed out at the configured rates, otherwise delivered after a
+// round trip. A simulated user opens some of the mail with button presses.
+// The app exits when idle and the next mail or press launches it again.
+//
+// It reports two latency distributions:
+//   notify to render  the phone starting to send a mail to its card drawn
+//   button to ack     a command's button press to the phone's ack, through
+//                     any retries, or to the error shown
+//
+//   sim_phone [name=value ...]
+//     seed=1 mails=200 interval=20000 latency=40 jitter=20 launch=0
+//     busy=0 reject=0 timeout=0 timeout_ms=2000 act=50
+// Times are in ms and rates in percent.
+#include "enotify_host.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define TICK_MS 5
+#define FRAME_MS 30
+#define MAX_QUEUE 64
+#define MAX_SAMPLES 4096
+#define BODY_CHUNK 80
+// Give up on a mail whose card never draws, e.g. filtered out of view
+#define RENDER_GIVE_UP_MS 60000
+
+typedef struct config_t {
+  unsigned seed;
+  int mails;
+  int interval;
+  int latency;
+  int jitter;
+  int launch;
+  int busy;
+  int reject;
+  int timeout;
+  int timeout_ms;
+  int act;
+} config_t;
+
+static config_t config = {
+  .seed = 1, .mails = 200, .interval = 20000, .latency = 40, .jitter = 20, .launch = 0,
+  .busy = 0, .reject = 0, .timeout = 0, .timeout_ms = 2000, .act = 50,
+};
+
+typedef struct samples_t {
+  const char *name;
+  int count;
+  uint32_t ms[MAX_SAMPLES];
+} samples_t;
+
+static samples_t notify_render = { "notify to render" };
+static samples_t button_ack = { "button to ack" };
+
+// Messages on their way from the phone, in the order sent
+typedef struct inbound_t {
+  uint32_t due;
+  bool header;
+  uint32_t sent;
+  uint16_t size;
+  uint8_t data[APP_MAX_DICT];
+} inbound_t;
+
+static inbound_t queue[MAX_QUEUE];
+static int queue_head, queue_count;
+static uint32_t link_free;
+
+static uint32_t now;
+static uint32_t rng_state;
+static bool app_open;
+
+// The watch's message in flight and when and how the phone answers it
+static bool outbox_scheduled;
+static uint32_t outbox_due;
+static AppMessageResult outbox_result;
+
+// Mail sent by the phone whose card has not been drawn yet
+static uint32_t render_waiting[MAX_QUEUE];
+static int render_waiting_count;
+
+// The user's next press and the command waiting for its ack
+static uint32_t press_due;
+static ButtonId press_button;
+static int press_step;
+static bool command_waiting;
+static uint32_t command_start;
+
+static uint32_t counts_busy, counts_reject, counts_timeout, counts_errors, counts_launches, counts_skipped;
+
+static uint32_t rng()
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+static bool chance(int percent)
+{
+  return (int)(rng() % 100) < percent;
+}
+
+static uint32_t link_delay()
+{
+  int delay = config.latency + (config.jitter > 0 ? (int)(rng() % (2*config.jitter+1)) - config.jitter : 0);
+  return delay > 0 ? delay : 0;
+}
+
+static void add_sample(samples_t *samples, uint32_t ms)
+{
+  if( samples->count < MAX_SAMPLES )
+    samples->ms[samples->count++] = ms;
+}
+
+//
+// The app's lifecycle
+//
+
+static void launch(AppLaunchReason reason)
+{
+  app_launch(reason);
+  app_open = true;
+  outbox_scheduled = false;
+  counts_launches++;
+}
+
+static void close_app()
+{
+  do_deinit();
+  host_restart();
+  app_open = false;
+  outbox_scheduled = false;
+  render_waiting_count = 0;
+  if( command_waiting )
+  {
+    counts_errors++;
+    command_waiting = false;
+  }
+}
+
+//
+// Phone to watch
+//
+
+static void phone_send(app_dict_t *dict, bool header)
+{
+  if( queue_count == MAX_QUEUE )
+  {
+    fprintf(stderr, "sim_phone: phone queue full\n");
+    exit(2);
+  }
+
+  // One message on the link at a time, as AppMessage acks each
+  uint32_t start = link_free > now ? link_free : now;
+  inbound_t *message = &queue[(queue_head+queue_count++) % MAX_QUEUE];
+  message->due = start + link_delay();
+  message->header = header;
+  message->sent = now;
+  message->size = dict_write_end(&dict->iter);
+  memcpy(message->data, dict->buffer, message->size);
+  link_free = message->due;
+}
+
+static void phone_send_mail(int mail)
+{
+  char uuid[16];
+  snprintf(uuid, sizeof(uuid), "sim%05d", mail);
+  app_dict_t dict;
+  DictionaryIterator *iter = app_dict_header(&dict, uuid, 1 + mail%3, false);
+  dict_write_uint8(iter, KEY_VIBE_PATTERN, VIBE_PATTERN_SHORT);
+  phone_send(&dict, true);
+
+  char body[MAX_TEXT_LENGTH];
+  int length = snprintf(body, sizeof(body), "Mail %d from the phone simulator. %s", mail,
+                        mail % 2 ? "A long one, sent in two chunks so the second is appended to the first." : "Short.");
+  for( int at = 0; at < length; at += BODY_CHUNK )
+  {
+    char chunk[BODY_CHUNK+1];
+    snprintf(chunk, sizeof(chunk), "%s", &body[at]);
+    iter = app_dict_begin(&dict);
+    dict_write_cstring(iter, KEY_MSG_UUID, uuid);
+    uint8_t encoding = (at > 0 ? MSG_ENCODING_APPEND : 0) | (at+BODY_CHUNK < length ? MSG_ENCODING_MORE : 0);
+    if( encoding )
+      dict_write_uint8(iter, KEY_MSG_ENCODING, encoding);
+    dict_write_cstring(iter, KEY_MSG_TEXT, chunk);
+    phone_send(&dict, false);
+  }
+}
+
+static void deliver_due()
+{
+  while( queue_count > 0 && queue[queue_head].due <= now )
+  {
+    inbound_t *message = &queue[queue_head];
+    if( !app_open )
+    {
+      // The phone launches the app and the message waits for it
+      launch(APP_LAUNCH_PHONE);
+      message->due = now + config.launch;
+      if( config.launch > 0 )
+        return;
+    }
+
+    if( message->header && render_waiting_count < MAX_QUEUE )
+      render_waiting[render_waiting_count++] = message->sent;
+    host_receive(message->data, message->size);
+    queue_head = (queue_head+1) % MAX_QUEUE;
+    queue_count--;
+  }
+}
+
+//
+// Watch to phone
+//
+
+// The phone's answer to a watch message it received
+static void phone_respond(DictionaryIterator *sent)
+{
+  Tuple *cmd = dict_find(sent, KEY_CMD);
+  if( cmd == NULL || cmd->value->int32 != VAL_CMD_HELLO )
+    return;
+
+  app_dict_t dict;
+  DictionaryIterator *iter = app_dict_begin(&dict);
+  Tuple *local_time = dict_find(sent, KEY_LOCAL_TIME);
+  if( local_time )
+    dict_write_int32(iter, KEY_UTC_OFFSET, 0);
+  dict_write_uint8(iter, KEY_ACTION_SUPPORT, 1);
+  phone_send(&dict, false);
+}
+
+static void schedule_outbox()
+{
+  if( !app_open || outbox_scheduled || !host_outbox_pending() )
+    return;
+
+  outbox_scheduled = true;
+  uint32_t round_trip = link_delay() + link_delay();
+  if( chance(config.timeout) )
+  {
+    outbox_result = APP_MSG_SEND_TIMEOUT;
+    outbox_due = now + config.timeout_ms;
+  }
+  else
+  {
+    outbox_due = now + round_trip;
+    if( chance(config.busy) )
+      outbox_result = APP_MSG_BUSY;
+    else if( chance(config.reject) )
+      outbox_result = APP_MSG_SEND_REJECTED;
+    else
+      outbox_result = APP_MSG_OK;
+  }
+}
+
+static void complete_outbox()
+{
+  if( !outbox_scheduled || outbox_due > now )
+    return;
+
+  outbox_scheduled = false;
+  if( outbox_result == APP_MSG_BUSY )
+    counts_busy++;
+  else if( outbox_result == APP_MSG_SEND_REJECTED )
+    counts_reject++;
+  else if( outbox_result == APP_MSG_SEND_TIMEOUT )
+    counts_timeout++;
+  else
+    phone_respond(host_outbox());
+  host_outbox_complete(outbox_result);
+}
+
+//
+// The user
+//
+
+// Opens a mail that has just arrived, some of the time: into the action
+// mode and a reply or open, or a delete
+static void plan_interaction()
+{
+  if( press_step != 0 || !chance(config.act) )
+    return;
+  press_step = 1;
+  press_due = now + 2000 + rng() % 6000;
+  press_button = chance(30) ? BUTTON_ID_SELECT : BUTTON_ID_BACK;
+}
+
+static void press_due_button()
+{
+  if( press_step == 0 || press_due > now )
+    return;
+
+  if( !app_open )
+  {
+    launch(APP_LAUNCH_USER);
+    press_due = now + DEFERRED_LOAD_MS + TICK_MS;
+    return;
+  }
+
+  // Only start from the cards with nothing outstanding
+  if( press_step == 1 && (mode != MODE_SCROLL || !actions_enabled || !app_metadata.actions_enabled || view_count == 0) )
+  {
+    counts_skipped++;
+    press_step = 0;
+    return;
+  }
+
+  bool was_enabled = actions_enabled;
+  host_click(press_button, false, 0);
+  if( was_enabled && !actions_enabled )
+  {
+    command_waiting = true;
+    command_start = now;
+  }
+
+  if( press_step == 1 )
+  {
+    // Then the command: a reply or open from the action mode, the
+    // confirmation of a delete
+    static const ButtonId actions[] = { BUTTON_ID_UP, BUTTON_ID_SELECT, BUTTON_ID_DOWN };
+    if( press_button == BUTTON_ID_BACK )
+      press_button = actions[rng() % 3];
+    press_step = 2;
+    press_due = now + 300 + rng() % 700;
+  }
+  else if( press_step == 2 && mode == MODE_ACTION )
+  {
+    press_button = BUTTON_ID_BACK;
+    press_step = 3;
+    press_due = now + 1000;
+  }
+  else
+    press_step = 0;
+}
+
+static void check_command()
+{
+  if( !command_waiting || !actions_enabled )
+    return;
+  command_waiting = false;
+  if( mode == MODE_ERROR )
+    counts_errors++;
+  add_sample(&button_ack, now - command_start);
+}
+
+static void render_frame()
+{
+  if( !app_open || now % FRAME_MS != 0 )
+    return;
+  host_render();
+
+  if( render_waiting_count > 0 && render_pending_slot == -1 )
+  {
+    for( int i = 0; i < render_waiting_count; i++ )
+      add_sample(&notify_render, now - render_waiting[i]);
+    render_waiting_count = 0;
+    plan_interaction();
+  }
+  else if( render_waiting_count > 0 && now - render_waiting[0] > RENDER_GIVE_UP_MS )
+    render_waiting_count = 0;
+}
+
+//
+// Reporting
+//
+
+static int compare_ms(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static void report(samples_t *samples)
+{
+  static const uint32_t bounds[] = { 50, 100, 250, 500, 1000, 2000, 5000 };
+  #define NUM_BOUNDS (sizeof(bounds)/sizeof(bounds[0]))
+
+  printf("%s: %d samples", samples->name, samples->count);
+  if( samples->count == 0 )
+  {
+    printf("\n");
+    return;
+  }
+  qsort(samples->ms, samples->count, sizeof(samples->ms[0]), compare_ms);
+  #define PERCENTILE(p) samples->ms[(samples->count-1)*(p)/100]
+  printf(", p50 %u ms, p90 %u ms, p99 %u ms, max %u ms\n", (unsigned)PERCENTILE(50), (unsigned)PERCENTILE(90),
+         (unsigned)PERCENTILE(99), (unsigned)samples->ms[samples->count-1]);
+
+  int buckets[NUM_BOUNDS+1] = { 0 };
+  for( int i = 0; i < samples->count; i++ )
+  {
+    size_t bucket = 0;
+    while( bucket < NUM_BOUNDS && samples->ms[i] > bounds[bucket] )
+      bucket++;
+    buckets[bucket]++;
+  }
+  for( size_t bucket = 0; bucket <= NUM_BOUNDS; bucket++ )
+  {
+    char label[16];
+    if( bucket < NUM_BOUNDS )
+      snprintf(label, sizeof(label), "<= %u", (unsigned)bounds[bucket]);
+    else
+      snprintf(label, sizeof(label), "> %u", (unsigned)bounds[NUM_BOUNDS-1]);
+    int bar = (buckets[bucket]*50 + samples->count-1) / samples->count;
+    printf("  %8s ms %5d %.*s\n", label, buckets[bucket], bar, "##################################################");
+  }
+}
+
+static bool parse(const char *arg)
+{
+  static const struct { const char *name; int *value; } options[] = {
+    { "mails", &config.mails }, { "interval", &config.interval }, { "latency", &config.latency },
+    { "jitter", &config.jitter }, { "launch", &config.launch }, { "busy", &config.busy },
+    { "reject", &config.reject }, { "timeout", &config.timeout }, { "timeout_ms", &config.timeout_ms },
+    { "act", &config.act },
+  };
+  const char *equals = strchr(arg, '=');
+  if( equals == NULL )
+    return false;
+  size_t length = equals - arg;
+  if( length == 4 && strncmp(arg, "seed", 4) == 0 )
+  {
+    config.seed = (unsigned)atol(equals+1);
+    return true;
+  }
+  for( size_t i = 0; i < sizeof(options)/sizeof(options[0]); i++ )
+  {
+    if( strlen(options[i].name) == length && strncmp(arg, options[i].name, length) == 0 )
+    {
+      *options[i].value = atoi(equals+1);
+      return true;
+    }
+  }
+  return false;
+}
+
+int main(int argc, char **argv)
+{
+  for( int i = 1; i < argc; i++ )
+  {
+    if( !parse(argv[i]) )
+    {
+      fprintf(stderr, "sim_phone: unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  rng_state = config.seed ? config.seed : 1;
+
+  printf("sim_phone: %d mails every ~%d ms, latency %d+-%d ms, launch %d ms, busy %d%%, reject %d%%, timeout %d%% (%d ms), act %d%%\n",
+         config.mails, config.interval, config.latency, config.jitter, config.launch, config.busy, config.reject,
+         config.timeout, config.timeout_ms, config.act);
+
+  host_reset();
+  int mails = 0;
+  uint32_t next_mail = 0;
+  while( mails < config.mails || queue_count > 0 || render_waiting_count > 0 || press_step != 0 || command_waiting )
+  {
+    if( mails < config.mails && now >= next_mail )
+    {
+      phone_send_mail(mails++);
+      // Exponential gaps, as independent mail arrives
+      double uniform = (rng() % 10000 + 1) / 10001.0;
+      next_mail = now + (uint32_t)(-config.interval * log(uniform));
+    }
+
+    deliver_due();
+    complete_outbox();
+    press_due_button();
+    check_command();
+    schedule_outbox();
+
+    host_advance(TICK_MS);
+    now += TICK_MS;
+    if( app_open && host_exited )
+      close_app();
+    render_frame();
+  }
+  if( app_open )
+    close_app();
+
+  printf("%u launches, %u busy, %u rejected, %u timed out, %u commands ended in an error, %u interactions skipped\n",
+         (unsigned)counts_launches, (unsigned)counts_busy, (unsigned)counts_reject, (unsigned)counts_timeout,
+         (unsigned)counts_errors, (unsigned)counts_skipped);
+  report(&notify_render);
+  report(&button_ack);
+  return 0;
+}
@@ -0,0 +1,166 @@
+// Message ages across clock changes: the format_age buckets, utc_now against
+// the phone's offset, ages staying put when a DST change or travel moves the
+// watch clock and the offset together, and the new offset surviving a launch
+// that follows a crash rather than a clean exit.
+#include "enotify_host.h"
+
+#define MINUTE 60
+#define HOUR (60*MINUTE)
+#define DAY (24*HOUR)
+
+#define MAX_DICT 256
+
+static int failures;
+
+#define CHECK(cond) do { if( !(cond) ) { printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+static void check_age(time_t age, const char *expected)
+{
+  char text[MAX_TEXT_LENGTH];
+  format_age(text, age);
+  if( strcmp(text, expected) != 0 )
+  {
+    printf("format_age(%ld) is \"%s\", expected \"%s\"\n", (long)age, text, expected);
+    failures++;
+  }
+}
+
+static void test_format_age()
+{
+  // A phone clock a little ahead of the watch gives negative ages
+  check_age(-5*MINUTE, "Just Now");
+  check_age(0, "Just Now");
+  check_age(2*MINUTE-1, "Just Now");
+  check_age(2*MINUTE, "2 Minutes Ago");
+  check_age(HOUR-1, "59 Minutes Ago");
+  check_age(HOUR, "An Hour Ago");
+  check_age(2*HOUR-1, "An Hour Ago");
+  check_age(2*HOUR, "2 Hours Ago");
+  check_age(DAY-1, "23 Hours Ago");
+  check_age(DAY, "1 Days Ago");
+  check_age(400*DAY, "400 Days Ago");
+}
+
+static void receive_offset(int32_t offset)
+{
+  uint8_t buffer[MAX_DICT];
+  DictionaryIterator iter;
+  dict_write_begin(&iter, buffer, sizeof(buffer));
+  dict_write_int32(&iter, KEY_UTC_OFFSET, offset);
+  host_receive(buffer, dict_write_end(&iter));
+}
+
+static void receive_message(const char *uuid, int32_t sent)
+{
+  uint8_t buffer[MAX_DICT];
+  DictionaryIterator iter;
+  dict_write_begin(&iter, buffer, sizeof(buffer));
+  dict_write_cstring(&iter, KEY_MSG_UUID, uuid);
+  dict_write_int32(&iter, KEY_MSG_TIME, sent);
+  dict_write_cstring(&iter, KEY_MSG_FROM, "someone@example.com");
+  dict_write_cstring(&iter, KEY_MSG_SUBJECT, "Subject");
+  host_receive(buffer, dict_write_end(&iter));
+}
+
+static void launch(AppLaunchReason reason)
+{
+  app_launch(reason);
+  host_advance(DEFERRED_LOAD_MS);
+}
+
+// Offsets are the watch's local time less UTC, as the phone sends them
+static void test_utc_now()
+{
+  host_reset();
+  launch(APP_LAUNCH_USER);
+
+  CHECK(utc_now() == time(NULL));
+  receive_offset(2*HOUR);
+  CHECK(utc_now() == time(NULL) - 2*HOUR);
+  receive_offset(-5*HOUR);
+  CHECK(utc_now() == time(NULL) + 5*HOUR);
+
+  do_deinit();
+}
+
+static void test_offset_changes()
+{
+  host_reset();
+  launch(APP_LAUNCH_USER);
+
+  // Winter time in Central Europe, a message sent half an hour ago
+  receive_offset(HOUR);
+  receive_message("age-1", (int32_t)(utc_now() - 30*MINUTE));
+  CHECK(app_metadata.num_messages_filled == 1);
+  int8_t slot = app_metadata.order[0];
+  CHECK(strcmp(header_text[slot], "30 Minutes Ago") == 0);
+
+  // Saved by a clean exit
+  do_deinit();
+  host_restart();
+  launch(APP_LAUNCH_USER);
+  CHECK(app_metadata.utc_offset == HOUR);
+  CHECK(app_metadata.num_messages_filled == 1);
+  CHECK(strcmp(header_text[slot], "30 Minutes Ago") == 0);
+
+  // Clocks go forward: until the phone sends the new offset the message
+  // looks an hour older than it is
+  host_clock += HOUR;
+  update_ages();
+  CHECK(strcmp(header_text[slot], "An Hour Ago") == 0);
+  receive_offset(2*HOUR);
+  CHECK(app_metadata.utc_offset == 2*HOUR);
+  CHECK(strcmp(header_text[slot], "30 Minutes Ago") == 0);
+
+  // The same offset again is not written again
+  uint32_t writes = metrics_get(METRIC_PERSIST_WRITES);
+  receive_offset(2*HOUR);
+  CHECK(metrics_get(METRIC_PERSIST_WRITES) == writes);
+
+  // No exit handler: the offset was saved when it arrived, and the message
+  // saved by the clean exit is still there beside it
+  host_restart();
+  launch(APP_LAUNCH_USER);
+  CHECK(app_metadata.utc_offset == 2*HOUR);
+  CHECK(app_metadata.num_messages_filled == 1);
+  CHECK(app_metadata.order[0] == slot);
+  CHECK(strcmp(header_text[slot], "30 Minutes Ago") == 0);
+
+  // A flight west, the watch clock set back six hours
+  host_clock -= 6*HOUR;
+  receive_offset(-4*HOUR);
+  CHECK(strcmp(header_text[slot], "30 Minutes Ago") == 0);
+  host_restart();
+  launch(APP_LAUNCH_USER);
+  CHECK(app_metadata.utc_offset == -4*HOUR);
+  CHECK(strcmp(header_text[slot], "30 Minutes Ago") == 0);
+
+  do_deinit();
+}
+
+// An offset arriving before anything was ever saved makes an empty store
+static void test_offset_first_launch()
+{
+  host_reset();
+  launch(APP_LAUNCH_PHONE);
+  receive_offset(3*HOUR);
+
+  host_restart();
+  launch(APP_LAUNCH_USER);
+  CHECK(app_metadata.utc_offset == 3*HOUR);
+  CHECK(app_metadata.num_messages_filled == 0);
+  CHECK(view_count == 0);
+
+  do_deinit();
+}
+
+int main(int argc, char **argv)
+{
+  test_format_age();
+  test_utc_now();
+  test_offset_changes();
+  test_offset_first_launch();
+
+  printf("test_ages: %s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,257 @@
+// Button presses through the real click handlers and mode_transitions: every
+// button in every mode, then scripted sequences through MODE_SCROLL,
+// MODE_ACTION, MODE_DELETE_CONFIRM and MODE_ERROR with the command acks and
+// failures in between. Each press is held to what the transition table
+// allows: the next mode it names, a send only for a command, a full icon
+// set only when the icon set changes, at most one layer marked dirty and no
+// persist writes. Long presses outside the table refill the list instead.
+// Run with -v for the cost of each press.
+#include "enotify_host.h"
+
+#define STORED 3
+
+// The list layer, the only one a press redraws; cards move by scrolling
+#define MAX_LAYERS_DIRTIED_PER_PRESS 1
+// Filtering the list refills the view: every card and the list
+#define MAX_LAYERS_DIRTIED_PER_LONG_PRESS (MAX_MESSAGES+1)
+// A command's ack saves the message it retired, header and body
+#define MAX_PERSIST_WRITES_PER_ACK 2
+
+static int failures;
+static bool verbose;
+
+#define CHECK(cond) do { if( !(cond) ) { printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+static const char *mode_names[NUM_MODES] = {
+  [MODE_SCROLL] = "scroll",
+  [MODE_ACTION] = "action",
+  [MODE_DELETE_CONFIRM] = "delete",
+  [MODE_ERROR] = "error",
+  [MODE_LIST] = "list",
+};
+
+static const char *button_names[NUM_BUTTONS] = {
+  [BUTTON_ID_BACK] = "back",
+  [BUTTON_ID_UP] = "up",
+  [BUTTON_ID_SELECT] = "select",
+  [BUTTON_ID_DOWN] = "down",
+};
+
+// A store of STORED messages with phone side actions on, fully loaded, and
+// the launch hello delivered
+static void launch_with_store()
+{
+  host_reset();
+  app_launch(APP_LAUNCH_USER);
+  host_advance(DEFERRED_LOAD_MS);
+  host_outbox_complete(APP_MSG_OK);
+
+  app_dict_t dict;
+  dict_write_uint8(app_dict_begin(&dict), KEY_ACTION_SUPPORT, 1);
+  app_dict_send(&dict);
+  char uuid[16];
+  for( int i = 0; i < STORED; i++ )
+  {
+    snprintf(uuid, sizeof(uuid), "m%d", i);
+    app_send_header(uuid, 1+i%2, false);
+  }
+  body_pending = 0;
+  CHECK(mode == MODE_SCROLL);
+  CHECK(view_count == STORED);
+}
+
+static bool shows_icons(uint8_t for_mode)
+{
+  return for_mode == MODE_SCROLL || for_mode == MODE_ACTION || for_mode == MODE_LIST;
+}
+
+// Presses button and checks what it cost against the transition it took
+static host_counters_t press(ButtonId button, bool long_press)
+{
+  uint8_t from = mode;
+  uint8_t icons_from = icon_mode;
+  host_counters_t before = host_counters;
+  host_click(button, long_press, 0);
+
+  host_counters_t cost = {
+    .icon_sets = host_counters.icon_sets - before.icon_sets,
+    .layers_dirtied = host_counters.layers_dirtied - before.layers_dirtied,
+    .sends = host_counters.sends - before.sends,
+    .persist_writes = host_counters.persist_writes - before.persist_writes,
+    .persist_bytes = host_counters.persist_bytes - before.persist_bytes,
+  };
+  if( verbose )
+    printf("  %-7s %-6s%s -> %-7s icons %u, dirtied %u, sends %u, persist writes %u\n", mode_names[from],
+           button_names[button], long_press ? " (long)" : "", mode_names[mode], (unsigned)cost.icon_sets,
+           (unsigned)cost.layers_dirtied, (unsigned)cost.sends, (unsigned)cost.persist_writes);
+
+  bool icons_change = shows_icons(mode) && mode != icons_from;
+  CHECK(cost.icon_sets == (icons_change ? 3 : 0));
+  CHECK(cost.layers_dirtied <= (long_press ? MAX_LAYERS_DIRTIED_PER_LONG_PRESS : MAX_LAYERS_DIRTIED_PER_PRESS));
+  CHECK(cost.sends <= 1);
+  CHECK(cost.persist_writes == 0);
+  return cost;
+}
+
+// Every button in every mode goes where mode_transitions says, sending its
+// command if it has one
+static void test_transition_table()
+{
+  if( verbose )
+    printf("transition table:\n");
+  for( uint8_t from = 0; from < NUM_MODES; from++ )
+  {
+    for( ButtonId button = 0; button < NUM_BUTTONS; button++ )
+    {
+      launch_with_store();
+      set_mode(from);
+      const mode_transition_t *transition = &mode_transitions[from][button];
+      host_counters_t cost = press(button, false);
+      CHECK(mode == transition->next_mode);
+      CHECK(cost.sends == (transition->command != NO_COMMAND ? 1 : 0));
+      if( transition->command != NO_COMMAND )
+        CHECK(msg_cmd == transition->command);
+      do_deinit();
+    }
+  }
+}
+
+// Completes the command in the outbox and checks what the ack cost
+static void ack(AppMessageResult result)
+{
+  CHECK(host_outbox_pending());
+  host_counters_t before = host_counters;
+  host_outbox_complete(result);
+  CHECK(host_counters.persist_writes - before.persist_writes <= MAX_PERSIST_WRITES_PER_ACK);
+  CHECK(host_counters.sends == before.sends);
+}
+
+static void test_delete()
+{
+  if( verbose )
+    printf("delete:\n");
+  launch_with_store();
+  int8_t slot = current_slot();
+
+  press(BUTTON_ID_DOWN, false);
+  CHECK(cursor == 1);
+  press(BUTTON_ID_UP, false);
+  CHECK(cursor == 0);
+
+  // Anything but select backs out of the confirmation
+  press(BUTTON_ID_SELECT, false);
+  CHECK(mode == MODE_DELETE_CONFIRM);
+  press(BUTTON_ID_UP, false);
+  CHECK(mode == MODE_SCROLL);
+  CHECK(!host_outbox_pending());
+
+  press(BUTTON_ID_SELECT, false);
+  press(BUTTON_ID_SELECT, false);
+  CHECK(mode == MODE_SCROLL);
+  CHECK(msg_cmd == VAL_CMD_DELETE);
+
+  // Presses are ignored until the phone answers
+  CHECK(actions_enabled == 0);
+  host_counters_t cost = press(BUTTON_ID_SELECT, false);
+  CHECK(mode == MODE_SCROLL);
+  CHECK(cost.sends == 0);
+
+  ack(APP_MSG_OK);
+  CHECK(actions_enabled == 1);
+  CHECK(deleted_slots & SLOT_BIT(slot));
+  do_deinit();
+}
+
+static void test_actions()
+{
+  if( verbose )
+    printf("actions:\n");
+  launch_with_store();
+
+  press(BUTTON_ID_BACK, false);
+  CHECK(mode == MODE_ACTION);
+  static const ButtonId buttons[] = { BUTTON_ID_UP, BUTTON_ID_SELECT, BUTTON_ID_DOWN };
+  static const int commands[] = { VAL_CMD_REPLY1, VAL_CMD_OPEN, VAL_CMD_REPLY2 };
+  for( int i = 0; i < 3; i++ )
+  {
+    host_counters_t cost = press(buttons[i], false);
+    CHECK(cost.sends == 1);
+    CHECK(msg_cmd == commands[i]);
+    CHECK(mode == MODE_ACTION);
+    ack(APP_MSG_OK);
+  }
+  press(BUTTON_ID_BACK, false);
+  CHECK(mode == MODE_SCROLL);
+  do_deinit();
+}
+
+// A command that keeps failing is retried, then shows the error, which any
+// press or the timeout dismisses
+static void test_error()
+{
+  if( verbose )
+    printf("error:\n");
+  launch_with_store();
+
+  press(BUTTON_ID_BACK, false);
+  press(BUTTON_ID_UP, false);
+  for( int i = 0; i < COMMAND_MAX_RETRIES; i++ )
+  {
+    ack(APP_MSG_SEND_TIMEOUT);
+    CHECK(mode == MODE_ACTION);
+    host_advance(COMMAND_RETRY_MS);
+  }
+  ack(APP_MSG_SEND_TIMEOUT);
+  CHECK(mode == MODE_ERROR);
+  CHECK(actions_enabled == 1);
+
+  host_counters_t cost = press(BUTTON_ID_DOWN, false);
+  CHECK(mode == MODE_SCROLL);
+  CHECK(cost.sends == 0);
+
+  // Left alone the error goes by itself
+  press(BUTTON_ID_BACK, false);
+  press(BUTTON_ID_SELECT, false);
+  host_outbox_complete(APP_MSG_NOT_CONNECTED);
+  CHECK(mode == MODE_ERROR);
+  host_advance(3000);
+  CHECK(mode == MODE_SCROLL);
+  do_deinit();
+}
+
+// The list, its account filter and the card it drills into
+static void test_list()
+{
+  if( verbose )
+    printf("list:\n");
+  launch_with_store();
+
+  press(BUTTON_ID_SELECT, true);
+  CHECK(mode == MODE_LIST);
+  press(BUTTON_ID_DOWN, false);
+  CHECK(cursor == 1);
+  press(BUTTON_ID_SELECT, true);
+  CHECK(account_filtered);
+  CHECK(view_count < STORED);
+  press(BUTTON_ID_SELECT, true);
+  CHECK(!account_filtered);
+  CHECK(view_count == STORED);
+  press(BUTTON_ID_SELECT, false);
+  CHECK(mode == MODE_SCROLL);
+  CHECK(!host_outbox_pending());
+  do_deinit();
+}
+
+int main(int argc, char **argv)
+{
+  verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+
+  test_transition_table();
+  test_delete();
+  test_actions();
+  test_error();
+  test_list();
+
+  printf("test_buttons: %s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,79 @@
+// The store load a launch defers until after the first frame: whatever gets
+// to the store first, the timer, a received message or a button press
+// sending a command, leaves every stored message in view.
+#include "enotify_host.h"
+
+#define STORED 3
+
+static int failures;
+
+#define CHECK(cond) do { if( !(cond) ) { printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+// A store of STORED messages with phone side actions on, saved by a clean
+// exit, then a launch that has drawn only the newest
+static void launch_with_store()
+{
+  host_reset();
+  app_launch(APP_LAUNCH_USER);
+  host_advance(DEFERRED_LOAD_MS);
+
+  app_dict_t dict;
+  dict_write_uint8(app_dict_begin(&dict), KEY_ACTION_SUPPORT, 1);
+  app_dict_send(&dict);
+  char uuid[16];
+  for( int i = 0; i < STORED; i++ )
+  {
+    snprintf(uuid, sizeof(uuid), "m%d", i);
+    app_send_header(uuid, 1, false);
+  }
+  do_deinit();
+  host_restart();
+
+  app_launch(APP_LAUNCH_USER);
+  CHECK(slots_loaded != ALL_SLOTS_LOADED);
+  CHECK(view_count == 1);
+}
+
+static void test_timer()
+{
+  launch_with_store();
+  host_advance(DEFERRED_LOAD_MS);
+  CHECK(slots_loaded == ALL_SLOTS_LOADED);
+  CHECK(view_count == STORED);
+  do_deinit();
+}
+
+static void test_receive_first()
+{
+  launch_with_store();
+  app_send_header("new", 1, false);
+  CHECK(view_count == STORED+1);
+  host_advance(DEFERRED_LOAD_MS);
+  CHECK(view_count == STORED+1);
+  do_deinit();
+}
+
+// Back then select opens the newest message on the phone before the timer
+static void test_command_first()
+{
+  launch_with_store();
+  host_click(BUTTON_ID_BACK, false, 0);
+  CHECK(mode == MODE_ACTION);
+  host_click(BUTTON_ID_SELECT, false, 0);
+  CHECK(host_outbox_pending());
+  CHECK(msg_cmd == VAL_CMD_OPEN);
+  CHECK(view_count == STORED);
+  host_advance(DEFERRED_LOAD_MS);
+  CHECK(view_count == STORED);
+  do_deinit();
+}
+
+int main(int argc, char **argv)
+{
+  test_timer();
+  test_receive_first();
+  test_command_first();
+
+  printf("test_deferred_load: %s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,120 @@
+// Which message a full store gives up under the default EVICT_PRIORITY
+// policy: deleted before read before unread, with account reserves and the
+// phone's priority messages kept for as long as something else can go.
+#include "enotify_host.h"
+
+static int failures;
+
+#define CHECK(cond) do { if( !(cond) ) { printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+// Launched by the phone, so nothing counts as read until the phone says so
+static void launch()
+{
+  host_reset();
+  app_launch(APP_LAUNCH_PHONE);
+  host_advance(DEFERRED_LOAD_MS);
+  CHECK(app_metadata.eviction_policy == EVICT_PRIORITY);
+  CHECK(app_metadata.account_reserve == 1);
+}
+
+static void send_messages(const char *prefix, int count, uint32_t account)
+{
+  char uuid[16];
+  for( int i = 0; i < count; i++ )
+  {
+    snprintf(uuid, sizeof(uuid), "%s%d", prefix, i);
+    app_send_header(uuid, account, false);
+  }
+}
+
+// An account's only message stays even once read, ahead of another
+// account's unread mail
+static void test_read_reserve()
+{
+  launch();
+  app_send_header("a0", 1, false);
+  app_send_sync(VAL_SYNC_MARK_READ, "a0");
+  CHECK(read_slots & SLOT_BIT(app_find("a0")));
+
+  send_messages("b", MAX_MESSAGES, 2);
+  CHECK(app_metadata.num_messages_filled == MAX_MESSAGES);
+  CHECK(account_messages(1) == 1);
+  CHECK(app_find("a0") >= 0);
+  CHECK(app_find("b0") < 0);
+  CHECK(app_find("b1") >= 0);
+  do_deinit();
+}
+
+// Above its reserve an account's read mail goes before anyone's unread mail
+static void test_read_first()
+{
+  launch();
+  app_send_header("a0", 1, false);
+  app_send_header("a1", 1, false);
+  app_send_sync(VAL_SYNC_MARK_READ, "a1");
+  send_messages("b", MAX_MESSAGES-2, 2);
+
+  app_send_header("c0", 3, false);
+  CHECK(app_find("a1") < 0);
+  CHECK(app_find("a0") >= 0);
+  CHECK(account_messages(2) == MAX_MESSAGES-2);
+  do_deinit();
+}
+
+// Deleted messages go first, reserve or not
+static void test_deleted_first()
+{
+  launch();
+  app_send_header("a0", 1, false);
+  send_messages("b", MAX_MESSAGES-1, 2);
+  app_send_sync(VAL_SYNC_DELETE, "a0");
+
+  app_send_header("c0", 2, false);
+  CHECK(app_find("a0") < 0);
+  CHECK(account_messages(2) == MAX_MESSAGES);
+  do_deinit();
+}
+
+// With every account at its reserve, a read message goes before the oldest
+// unread one
+static void test_all_reserved()
+{
+  launch();
+  char uuid[16];
+  for( int i = 0; i < MAX_MESSAGES; i++ )
+  {
+    snprintf(uuid, sizeof(uuid), "a%d", i);
+    app_send_header(uuid, 10+i, false);
+  }
+  app_send_sync(VAL_SYNC_MARK_READ, "a2");
+
+  app_send_header("z0", 99, false);
+  CHECK(app_find("a2") < 0);
+  CHECK(app_find("a0") >= 0);
+  do_deinit();
+}
+
+// Priority messages stay while the same account has normal ones to give up
+static void test_priority_kept()
+{
+  launch();
+  app_send_header("p0", 2, true);
+  send_messages("b", MAX_MESSAGES-1, 2);
+
+  app_send_header("b9", 2, false);
+  CHECK(app_find("p0") >= 0);
+  CHECK(app_find("b0") < 0);
+  do_deinit();
+}
+
+int main(int argc, char **argv)
+{
+  test_read_reserve();
+  test_read_first();
+  test_deleted_first();
+  test_all_reserved();
+  test_priority_kept();
+
+  printf("test_eviction: %s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
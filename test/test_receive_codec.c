@@ -0,0 +1,147 @@
+// Message bodies sent as text_codec chunks, through the app's real receive
+// handler: every line of corpus.txt as one MSG_ENCODING_CODEC chunk and as
+// MSG_ENCODING_APPEND chunks of several sizes, checked against the slot's
+// text on receipt and again after the store is read back at the next launch.
+#include "enotify_host.h"
+#include "text_codec.h"
+
+#define MAX_LINE 512
+#define INBOX_SIZE 120
+
+static int failures;
+
+#define CHECK(cond) do { if( !(cond) ) { printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+static int messages;
+
+// Sends one body chunk, or returns false if it would not fit in the inbox
+static bool send_chunk(const char *uuid, const char *text, size_t length, uint8_t encoding)
+{
+  char chunk[MAX_LINE];
+  uint8_t encoded[2*MAX_LINE];
+  memcpy(chunk, text, length);
+  chunk[length] = '\0';
+  int encoded_length = text_codec_encode(chunk, encoded, sizeof(encoded));
+  CHECK(encoded_length >= 0);
+
+  app_dict_t dict;
+  DictionaryIterator *iter = app_dict_begin(&dict);
+  dict_write_cstring(iter, KEY_MSG_UUID, uuid);
+  dict_write_uint8(iter, KEY_MSG_ENCODING, encoding);
+  dict_write_data(iter, KEY_MSG_TEXT, encoded, encoded_length);
+  if( dict_write_end(iter) > INBOX_SIZE )
+    return false;
+  app_dict_send(&dict);
+  return true;
+}
+
+// Sends text as chunks of at most chunk characters, smaller where the
+// encoded chunk would not fit in the inbox
+static void send_body(const char *uuid, const char *text, size_t chunk)
+{
+  size_t length = strlen(text);
+  size_t at = 0;
+  do
+  {
+    size_t size = length-at < chunk ? length-at : chunk;
+    uint8_t encoding = MSG_ENCODING_CODEC;
+    if( at > 0 )
+      encoding |= MSG_ENCODING_APPEND;
+    while( !send_chunk(uuid, &text[at], size, encoding | (at+size < length ? MSG_ENCODING_MORE : 0)) )
+      size--;
+    at += size;
+  } while( at < length );
+}
+
+static void check_body(const char *uuid, const char *expected)
+{
+  int8_t slot = app_metadata.order[0];
+  CHECK(strcmp(uuid_text[slot], uuid) == 0);
+  if( strcmp(scroll_text[slot], expected) != 0 )
+  {
+    printf("body \"%s\", expected \"%s\"\n", scroll_text[slot], expected);
+    failures++;
+  }
+  CHECK(!body_pending);
+}
+
+// Receives text as a new message's body and reads it back after a restart.
+// The slot keeps only the first MAX_TEXT_LENGTH-1 bytes.
+static void check_round_trip(const char *text, size_t chunk)
+{
+  char expected[MAX_TEXT_LENGTH];
+  strncpy(expected, text, sizeof(expected)-1);
+  expected[sizeof(expected)-1] = '\0';
+  char uuid[16];
+  snprintf(uuid, sizeof(uuid), "c%d", messages++);
+
+  app_send_header(uuid, 1, false);
+  send_body(uuid, expected, chunk);
+  check_body(uuid, expected);
+
+  do_deinit();
+  host_restart();
+  app_launch(APP_LAUNCH_PHONE);
+  host_advance(DEFERRED_LOAD_MS);
+  check_body(uuid, expected);
+}
+
+static void test_corpus(const char *path)
+{
+  FILE *corpus = fopen(path, "r");
+  CHECK(corpus != NULL);
+  if( corpus == NULL )
+    return;
+
+  host_reset();
+  app_launch(APP_LAUNCH_PHONE);
+  host_advance(DEFERRED_LOAD_MS);
+
+  // One chunk where it fits, then ever smaller appended chunks
+  static const size_t chunks[] = { MAX_TEXT_LENGTH, 48, 17, 5, 1 };
+  char line[MAX_LINE];
+  int lines = 0;
+  while( fgets(line, sizeof(line), corpus) )
+  {
+    line[strcspn(line, "\n")] = '\0';
+    for( size_t i = 0; i < sizeof(chunks)/sizeof(chunks[0]); i++ )
+      check_round_trip(line, chunks[i]);
+    lines++;
+  }
+  fclose(corpus);
+  CHECK(lines > 0);
+  do_deinit();
+}
+
+// A chunk without MSG_ENCODING_APPEND replaces what came before
+static void test_replace()
+{
+  host_reset();
+  app_launch(APP_LAUNCH_PHONE);
+  host_advance(DEFERRED_LOAD_MS);
+
+  app_send_header("r0", 1, false);
+  send_chunk("r0", "first part, ", 12, MSG_ENCODING_CODEC | MSG_ENCODING_MORE);
+  CHECK(body_pending);
+  send_chunk("r0", "second", 6, MSG_ENCODING_CODEC);
+  check_body("r0", "second");
+
+  // Appending past the end of the slot truncates rather than overflowing
+  char filler[MAX_TEXT_LENGTH];
+  memset(filler, 'x', sizeof(filler)-1);
+  filler[sizeof(filler)-1] = '\0';
+  send_chunk("r0", filler, 60, MSG_ENCODING_CODEC);
+  send_chunk("r0", filler, 60, MSG_ENCODING_CODEC | MSG_ENCODING_APPEND);
+  send_chunk("r0", filler, 60, MSG_ENCODING_CODEC | MSG_ENCODING_APPEND);
+  check_body("r0", filler);
+  do_deinit();
+}
+
+int main(int argc, char **argv)
+{
+  test_corpus(argc > 1 ? argv[1] : "corpus.txt");
+  test_replace();
+
+  printf("test_receive_codec: %s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
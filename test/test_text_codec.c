@@ -0,0 +1,119 @@
+// Round trip tests for src/text_codec.c: every line of corpus.txt, the
+// truncation and overflow contracts in text_codec.h, and a seeded random
+// round trip of arbitrary bytes.
+#include <pebble.h>
+#include <stdlib.h>
+#include "text_codec.h"
+
+#define MAX_TEXT 512
+
+static int failures;
+
+#define CHECK(cond) do { if( !(cond) ) { printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+static void check_round_trip(const char *text)
+{
+  uint8_t encoded[2*MAX_TEXT];
+  char decoded[MAX_TEXT+1];
+
+  int length = text_codec_encode(text, encoded, sizeof(encoded));
+  CHECK(length >= 0);
+  if( length < 0 )
+    return;
+
+  size_t decoded_length = text_codec_decode(encoded, length, decoded, sizeof(decoded));
+  CHECK(decoded_length == strlen(text));
+  CHECK(strcmp(decoded, text) == 0);
+}
+
+static void test_corpus(const char *path)
+{
+  FILE *corpus = fopen(path, "r");
+  CHECK(corpus != NULL);
+  if( corpus == NULL )
+    return;
+
+  char line[MAX_TEXT];
+  int lines = 0;
+  while( fgets(line, sizeof(line), corpus) )
+  {
+    line[strcspn(line, "\n")] = '\0';
+    check_round_trip(line);
+    lines++;
+  }
+  fclose(corpus);
+  CHECK(lines > 0);
+}
+
+static void test_edges()
+{
+  uint8_t encoded[16];
+  char decoded[16];
+
+  check_round_trip("");
+  check_round_trip("\x7f\x80\xfe\xff");
+
+  // Too small a buffer fails rather than writing past it
+  CHECK(text_codec_encode("abcdefgh", encoded, 4) == -1);
+  CHECK(text_codec_encode("\xff", encoded, 1) == -1);
+  CHECK(text_codec_encode("", encoded, 0) == 0);
+
+  // Decoding truncates to dest_size-1 characters, even mid dictionary entry
+  int length = text_codec_encode("Thank you", encoded, sizeof(encoded));
+  CHECK(length == 1);
+  CHECK(text_codec_decode(encoded, length, decoded, 5) == 4);
+  CHECK(strcmp(decoded, "Than") == 0);
+  CHECK(text_codec_decode(encoded, length, decoded, 0) == 0);
+
+  // A trailing escape with nothing after it is dropped
+  const uint8_t dangling[] = { 'a', 0xFF };
+  CHECK(text_codec_decode(dangling, sizeof(dangling), decoded, sizeof(decoded)) == 1);
+  CHECK(strcmp(decoded, "a") == 0);
+}
+
+// Random non-NUL bytes, biased towards ASCII so dictionary entries show up
+static void test_random(long cases, unsigned seed)
+{
+  srand(seed);
+  char text[MAX_TEXT+1];
+
+  for( long n = 0; n < cases; n++ )
+  {
+    int length = rand() % MAX_TEXT;
+    for( int i = 0; i < length; i++ )
+    {
+      int c = rand() % 4 ? ' ' + rand() % 95 : 1 + rand() % 255;
+      text[i] = (char)c;
+    }
+    text[length] = '\0';
+    check_round_trip(text);
+
+    // Whatever the phone sends, decoding stays within dest
+    uint8_t garbage[64];
+    char small[8];
+    for( size_t i = 0; i < sizeof(garbage); i++ )
+      garbage[i] = rand();
+    size_t decoded_length = text_codec_decode(garbage, rand() % sizeof(garbage), small, sizeof(small));
+    CHECK(decoded_length < sizeof(small) && small[decoded_length] == '\0');
+
+    if( failures > 0 )
+    {
+      printf("random case %ld (seed %u) failed\n", n, seed);
+      return;
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const char *corpus = argc > 1 ? argv[1] : "corpus.txt";
+  long cases = argc > 2 ? atol(argv[2]) : 200000;
+  unsigned seed = argc > 3 ? (unsigned)atol(argv[3]) : 1;
+
+  test_corpus(corpus);
+  test_edges();
+  test_random(cases, seed);
+
+  printf("test_text_codec: %s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
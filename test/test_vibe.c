@@ -0,0 +1,90 @@
+// Vibe coalescing in src/vibe.c: how many vibes a burst of requests plays,
+// the pulses in the summary, and requests for patterns that do not exist.
+#include <pebble.h>
+#include "vibe.h"
+
+#define BURST_MS 3000
+
+static int failures;
+
+#define CHECK(cond) do { if( !(cond) ) { printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+// Vibes played by a burst of count requests, one every 500 ms
+static uint32_t burst(int count, uint8_t pattern)
+{
+  host_reset();
+  vibe_init(true);
+  for( int i = 0; i < count; i++ )
+  {
+    vibe_request(pattern);
+    host_advance(500);
+  }
+  host_advance(BURST_MS);
+  vibe_deinit();
+  return host_counters.vibes;
+}
+
+static void test_bursts()
+{
+  CHECK(burst(1, VIBE_PATTERN_SHORT) == 1);
+  CHECK(burst(2, VIBE_PATTERN_LONG) == 1);
+
+  // The opening vibe, then one pulse per merged message
+  CHECK(burst(3, VIBE_PATTERN_DOUBLE) == 2);
+  CHECK(host_vibe_segments == 3);
+  CHECK(burst(20, VIBE_PATTERN_SHORT) == 2);
+  CHECK(host_vibe_segments == 5);
+}
+
+static void test_quiet_spell()
+{
+  host_reset();
+  vibe_init(true);
+  vibe_request(VIBE_PATTERN_SHORT);
+  host_advance(BURST_MS);
+  vibe_request(VIBE_PATTERN_SHORT);
+  host_advance(BURST_MS);
+  CHECK(host_counters.vibes == 2);
+  vibe_deinit();
+}
+
+static void test_unknown_patterns()
+{
+  CHECK(burst(5, NUM_VIBE_PATTERNS) == 0);
+  CHECK(burst(5, UINT8_MAX) == 0);
+
+  // Neither opens a burst nor adds to one
+  host_reset();
+  vibe_init(true);
+  vibe_request(0x7);
+  vibe_request(VIBE_PATTERN_SHORT);
+  CHECK(host_counters.vibes == 1);
+  vibe_request(0x7);
+  vibe_request(0x7);
+  vibe_request(VIBE_PATTERN_SHORT);
+  host_advance(BURST_MS);
+  CHECK(host_counters.vibes == 1);
+  vibe_deinit();
+}
+
+static void test_summary_off()
+{
+  host_reset();
+  vibe_init(false);
+  for( int i = 0; i < 5; i++ )
+    vibe_request(VIBE_PATTERN_SHORT);
+  host_advance(BURST_MS);
+  CHECK(host_counters.vibes == 1);
+  vibe_deinit();
+}
+
+int main(int argc, char **argv)
+{
+  test_bursts();
+  test_quiet_spell();
+  test_unknown_patterns();
+  test_summary_off();
+
+  printf("test_vibe: %s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}